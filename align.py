@@ -0,0 +1,192 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Copyright © 2025 Christian Conti, Alessandro Varaldi
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the Licence, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https:#www.gnu.org/licenses/>.
+
+
+"""Map the captures of several loggers onto one timebase.
+
+Each logger built with --sync timestamps the edges of a shared sync line
+and reports them as SYNC events (edge count, device time, arrival time on
+the host). The same edge is identified across loggers by its arrival
+time, which only needs to be right to within half a pulse period. The
+device timestamps of matched edges then give a piecewise linear map from
+each logger's clock to the reference logger's one. Drift is corrected
+between every pair of pulses, so the error is the edge timestamping
+jitter rather than the USB latency.
+
+    python align.py logs/board_a/power_log_X_events.csv logs/board_b/power_log_Y_events.csv
+
+The first events file is the reference. The sample CSVs of every other
+session are rewritten as <name>_aligned.csv with their time column(s) on
+the reference clock; those of the reference session get unwrapped copies
+under the same name, so all of them share one numbering past the wrap.
+"""
+
+import argparse
+import bisect
+import csv
+import statistics
+import sys
+from datetime import datetime
+from pathlib import Path
+
+# micros() wraps, the 64-bit ns clock does not
+WRAP_US = 1 << 32
+
+
+def _unwrap(t: int, near: int, time64: bool) -> int:
+    """The copy of a wrapped µs timestamp closest to `near`."""
+    if time64:
+        return t
+    return t + round((near - t) / WRAP_US) * WRAP_US
+
+
+def load_pulses(events: Path, time64: bool) -> list:
+    """(host time in s, device time) of every SYNC event, unwrapped."""
+    pulses = []
+    with events.open(newline="", encoding="utf-8") as f:
+        for row in csv.reader(f):
+            if row and row[0] == "SYNC" and len(row) >= 4:
+                pulses.append((datetime.fromisoformat(row[3]).timestamp(), int(row[2])))
+    pulses.sort()
+    out = []
+    for host, t in pulses:
+        out.append((host, _unwrap(t, out[-1][1], time64) if out else t))
+    return out
+
+
+def match(ref: list, other: list, period_s: float) -> list:
+    """(other device time, reference device time) of the edges both saw."""
+    ref_host = [p[0] for p in ref]
+    pairs = []
+    for host, t in other:
+        i = bisect.bisect_left(ref_host, host)
+        best = min((j for j in (i - 1, i) if 0 <= j < len(ref)), key=lambda j: abs(ref_host[j] - host), default=None)
+        if best is not None and abs(ref_host[best] - host) < period_s / 2:
+            pairs.append((t, ref[best][1]))
+    pairs.sort()
+    return pairs
+
+
+class ClockMap:
+    """Piecewise linear map between two device clocks through matched
+    edges, extrapolated with the slope of the outer segments."""
+
+    def __init__(self, pairs: list) -> None:
+        if not pairs:
+            raise ValueError("no sync pulse seen by both loggers")
+        self.src = [p[0] for p in pairs]
+        self.dst = [p[1] for p in pairs]
+
+    def __call__(self, t: float) -> float:
+        if len(self.src) == 1:
+            return t + self.dst[0] - self.src[0]
+        i = min(max(bisect.bisect_right(self.src, t), 1), len(self.src) - 1)
+        s0, s1 = self.src[i - 1], self.src[i]
+        d0, d1 = self.dst[i - 1], self.dst[i]
+        return d0 + (t - s0) * (d1 - d0) / (s1 - s0)
+
+    def drift_ppm(self) -> float:
+        """How much faster the source clock runs than the reference one."""
+        if len(self.src) < 2:
+            return 0.0
+        return ((self.src[-1] - self.src[0]) / (self.dst[-1] - self.dst[0]) - 1) * 1e6
+
+    def jitter(self) -> tuple:
+        """(RMS, max) distance of each inner edge from the line through its
+        neighbours, in device units: what the map cannot explain."""
+        res = []
+        for i in range(1, len(self.src) - 1):
+            s0, s1, s2 = self.src[i - 1:i + 2]
+            d0, d1, d2 = self.dst[i - 1:i + 2]
+            res.append(d1 - (d0 + (s1 - s0) * (d2 - d0) / (s2 - s0)))
+        if not res:
+            return 0.0, 0.0
+        return statistics.fmean(r * r for r in res) ** 0.5, max(abs(r) for r in res)
+
+
+def _base(events: Path) -> str:
+    return events.stem[:-len("_events")] if events.stem.endswith("_events") else events.stem
+
+
+def session_csvs(events: Path) -> list:
+    """Sample CSVs of the session that wrote `events`."""
+    return sorted(p for p in events.parent.glob(f"{_base(events)}*.csv")
+                  if p != events and not p.stem.endswith(("_hist", "_aligned", "_events", "_wstat")))
+
+
+def seed(path: Path, events: Path, pulses: list) -> int:
+    """Unwrapped device time of the pulse nearest the start of `path`.
+    Trigger window CSVs carry their host start time in the name; the
+    single CSV of an untriggered session starts with the session."""
+    try:
+        host = datetime.strptime(path.stem[len(_base(events)) + 1:], "%Y-%m-%d_%H-%M-%S.%f").timestamp()
+    except ValueError:
+        return pulses[0][1]
+    hosts = [p[0] for p in pulses]
+    i = bisect.bisect_left(hosts, host)
+    best = min((j for j in (i - 1, i) if 0 <= j < len(pulses)), key=lambda j: abs(hosts[j] - host))
+    return pulses[best][1]
+
+
+def rewrite(path: Path, cmap, time_cols: int, time64: bool, near: int) -> Path:
+    out = path.with_name(f"{path.stem}_aligned{path.suffix}")
+    with path.open(newline="", encoding="utf-8") as src, out.open("w", newline="", encoding="utf-8") as dst:
+        writer = csv.writer(dst)
+        for row in csv.reader(src):
+            if not row or row[0].startswith("value"):
+                writer.writerow(row)
+                continue
+            for c in range(min(time_cols, len(row))):
+                if row[c]:
+                    near = _unwrap(int(row[c]), near, time64)
+                    row[c] = str(round(cmap(near)))
+            writer.writerow(row)
+    return out
+
+
+def main(argv=None) -> None:
+    parser = argparse.ArgumentParser(prog="align.py", description="Align the captures of several loggers through their sync pulses")
+    parser.add_argument("reference", type=Path, help="Events CSV of the reference logger")
+    parser.add_argument("others", nargs="+", type=Path, help="Events CSVs of the loggers to align")
+    parser.add_argument("--period-ms", type=int, default=1000, help="Interval between sync pulses (default: 1000)")
+    parser.add_argument("--time64", action="store_true", help="Captures were made with --time64 (two ns time columns)")
+    args = parser.parse_args(argv)
+
+    time_cols = 2 if args.time64 else 1
+    unit = "ns" if args.time64 else "us"
+    try:
+        ref = load_pulses(args.reference, args.time64)
+        if not ref:
+            sys.exit(f"[ERROR]: No SYNC events in {args.reference}")
+        # The reference keeps its clock, only unwrapped
+        for path in session_csvs(args.reference):
+            near = seed(path, args.reference, ref)
+            print(f"[INFO]: Wrote {rewrite(path, lambda t: t, time_cols, args.time64, near)}")
+        for events in args.others:
+            pulses = load_pulses(events, args.time64)
+            cmap = ClockMap(match(ref, pulses, args.period_ms / 1000))
+            rms, worst = cmap.jitter()
+            print(f"[INFO]: {events}: {len(cmap.src)} pulses matched, drift {cmap.drift_ppm():+.2f} ppm, "
+                  f"residual {rms:.2f} {unit} RMS / {worst:.2f} {unit} max")
+            for path in session_csvs(events):
+                near = seed(path, events, pulses)
+                print(f"[INFO]: Wrote {rewrite(path, cmap, time_cols, args.time64, near)}")
+    except (OSError, ValueError) as exc:
+        sys.exit(f"[ERROR]: {exc}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,283 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Copyright © 2025 Christian Conti, Alessandro Varaldi
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the Licence, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https:#www.gnu.org/licenses/>.
+
+
+"""Batch summary of power_log.py captures.
+
+Every input file is processed by its own worker process. Journals (.plj)
+are summarised from their segment index, and only scanned when the index
+is missing. CSV logs are streamed row by row, so memory stays flat
+whatever the capture length. The result is one table with a row per
+segment and a total row per file:
+
+    python analyze.py logs/ -o summary.csv
+
+With --baseline, the per-segment energies of the inputs are instead
+compared against those of the baseline captures: difference of the means,
+relative change and Cohen's d with percentile bootstrap confidence
+intervals, and Cliff's delta. The exit status is 1 when energy went up by
+more than --threshold with confidence 1 - alpha, so it can gate CI jobs:
+
+    python analyze.py logs/new --baseline logs/old --threshold 1
+"""
+
+import argparse
+import bisect
+import csv
+import math
+import os
+import random
+import sys
+from multiprocessing import Pool
+from pathlib import Path
+
+from journal import SegmentBuilder, Session
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+# Side files written next to the sample CSVs, and align.py's copies of them
+SIDE_SUFFIXES = ("_events", "_hist", "_wstat", "_aligned")
+SUMMARY_HEADER = ["file", "segment", "t_start", "t_end", "rows", "duration_s", "energy_j", "mean_w", "peak_w"]
+# Resamples per bootstrap job, so every worker gets a share
+BOOT_CHUNK = 250
+# Cap on the index matrix one vectorised batch draws
+BOOT_BATCH_ELEMS = 1 << 22
+
+
+def _exported(path: Path) -> bool:
+    """CSV written by `journal.py export` next to its journal: <stem>.csv,
+    <stem>_<ts>.csv or <stem>_seg<ID>.csv."""
+    return any(path.stem == j.stem or path.stem.startswith(j.stem + "_")
+               for j in path.parent.glob("*.plj"))
+
+
+def find_captures(paths: list) -> list:
+    """Expand directories to the journals and sample CSVs below them. Copies
+    of a capture, i.e. align.py output and journal exports, are skipped."""
+    found = []
+    for path in paths:
+        if path.is_dir():
+            found += sorted(p for p in path.rglob("*") if p.suffix == ".plj"
+                            or (p.suffix == ".csv" and not p.stem.endswith(SIDE_SUFFIXES) and not _exported(p)))
+        else:
+            found.append(path)
+    # Overlapping arguments, e.g. a directory and a file inside it
+    return list(dict.fromkeys(p.resolve() for p in found))
+
+
+def _summary_row(name: str, label, t_start, t_end, rows: int, duration: float, energy: float, peak: float) -> list:
+    mean = energy / duration if duration > 0 else 0.0
+    return [name, label, t_start, t_end, rows, f"{duration:.6f}", f"{energy:.6f}", f"{mean:.6f}", f"{peak:.6f}"]
+
+
+def _segments(path: Path, time_cols: int, rails: int, tick_s: float) -> tuple:
+    """(segments, seconds per device time unit) of one capture."""
+    if path.suffix == ".plj":
+        with Session(path) as session:
+            return session.segments, session.tick_s
+
+    builder = SegmentBuilder(time_cols, rails, tick_s)
+    with path.open(newline="", encoding="utf-8") as f:
+        for values in csv.reader(f):
+            # Headers are repeated when rows get wider
+            if values and not values[0].startswith("value"):
+                builder.row(0, 0, values)
+    return builder.finish(), tick_s
+
+
+def summarize(job: tuple) -> list:
+    """Summary rows of one capture: (path, time_cols, rails, tick_s) -> rows."""
+    path = job[0]
+    try:
+        segments, tick_s = _segments(*job)
+    except (OSError, ValueError) as exc:
+        return [[str(path), "error", "", "", "", "", "", "", str(exc)]]
+
+    name = str(path)
+    rows = [_summary_row(name, s.id, s.t_start, s.t_end, s.rows, (s.t_end - s.t_start) * tick_s, s.energy_j, s.peak_w)
+            for s in segments]
+    if segments:
+        # Windows are disjoint: the idle time between them does not count
+        duration = sum(s.t_end - s.t_start for s in segments) * tick_s
+        rows.append(_summary_row(name, "all", "", "", sum(s.rows for s in segments), duration,
+                                 sum(s.energy_j for s in segments), max(s.peak_w for s in segments)))
+    return rows
+
+
+def segment_energies(job: tuple) -> list:
+    """Energy of every non-empty segment of one capture, same job as summarize()."""
+    try:
+        segments, _ = _segments(*job)
+    except (OSError, ValueError) as exc:
+        print(f"[WARN]: {exc}")
+        return []
+    return [s.energy_j for s in segments if s.t_end > s.t_start]
+
+
+def _mean_var(x: list) -> tuple:
+    m = math.fsum(x) / len(x)
+    return m, math.fsum((v - m) ** 2 for v in x) / (len(x) - 1)
+
+
+def _effects(a: list, b: list) -> tuple:
+    """(mean difference, relative change, Cohen's d) of b against a."""
+    (ma, va), (mb, vb) = _mean_var(a), _mean_var(b)
+    pooled = ((len(a) - 1) * va + (len(b) - 1) * vb) / (len(a) + len(b) - 2)
+    return mb - ma, mb / ma - 1 if ma else 0.0, (mb - ma) / math.sqrt(pooled) if pooled > 0 else 0.0
+
+
+def _bootstrap(job: tuple) -> list:
+    """(a, b, resamples, seed) -> [_effects() of each resample]. Vectorised
+    with numpy when it is installed, one resample at a time otherwise."""
+    a, b, count, seed = job
+    out = []
+    if np is not None:
+        rng = np.random.default_rng(seed)
+        a, b = np.asarray(a), np.asarray(b)
+        batch = max(1, BOOT_BATCH_ELEMS // max(len(a), len(b)))
+        while count > 0:
+            k = min(batch, count)
+            ra = a[rng.integers(0, len(a), (k, len(a)))]
+            rb = b[rng.integers(0, len(b), (k, len(b)))]
+            ma, mb = ra.mean(axis=1), rb.mean(axis=1)
+            pooled = ((len(a) - 1) * ra.var(axis=1, ddof=1) + (len(b) - 1) * rb.var(axis=1, ddof=1)) / (len(a) + len(b) - 2)
+            with np.errstate(divide="ignore", invalid="ignore"):
+                d = np.where(pooled > 0, (mb - ma) / np.sqrt(pooled), 0.0)
+                rel = np.where(ma != 0, mb / ma - 1, 0.0)
+            out += zip((mb - ma).tolist(), rel.tolist(), d.tolist())
+            count -= k
+        return out
+
+    rng = random.Random(seed)
+    for _ in range(count):
+        out.append(_effects(rng.choices(a, k=len(a)), rng.choices(b, k=len(b))))
+    return out
+
+
+def _cliff_delta(a: list, b: list) -> float:
+    """P(b > a) - P(b < a), O((n + m) log n) through a sorted baseline."""
+    a = sorted(a)
+    greater = less = 0
+    for x in b:
+        less += len(a) - bisect.bisect_right(a, x)
+        greater += bisect.bisect_left(a, x)
+    return (greater - less) / (len(a) * len(b))
+
+
+def _percentile(sorted_vals: list, q: float) -> float:
+    pos = q * (len(sorted_vals) - 1)
+    lo = int(pos)
+    hi = min(lo + 1, len(sorted_vals) - 1)
+    return sorted_vals[lo] + (sorted_vals[hi] - sorted_vals[lo]) * (pos - lo)
+
+
+def compare(pool: Pool, a: list, b: list, resamples: int, alpha: float, seed: int) -> dict:
+    """Effect sizes of b against the baseline a with bootstrap CIs."""
+    jobs = [(a, b, min(BOOT_CHUNK, resamples - i), seed + i) for i in range(0, resamples, BOOT_CHUNK)]
+    boot = [r for part in pool.imap_unordered(_bootstrap, jobs) for r in part]
+
+    point = _effects(a, b)
+    result = {"n": (len(a), len(b)), "mean": (_mean_var(a)[0], _mean_var(b)[0]), "cliff": _cliff_delta(a, b)}
+    for i, name in enumerate(("diff", "rel", "d")):
+        vals = sorted(r[i] for r in boot)
+        result[name] = (point[i], _percentile(vals, alpha / 2), _percentile(vals, 1 - alpha / 2))
+    return result
+
+
+def print_comparison(res: dict, alpha: float) -> None:
+    conf = f"{(1 - alpha) * 100:g}% CI"
+    diff, rel, d = res["diff"], res["rel"], res["d"]
+    print(f"{'':<18}{'baseline':>14}{'candidate':>14}")
+    print(f"{'segments':<18}{res['n'][0]:>14}{res['n'][1]:>14}")
+    print(f"{'mean energy [J]':<18}{res['mean'][0]:>14.6g}{res['mean'][1]:>14.6g}")
+    print(f"{'difference [J]':<18}{diff[0]:>14.6g}   {conf} [{diff[1]:.6g}, {diff[2]:.6g}]")
+    print(f"{'relative':<18}{rel[0] * 100:>13.3f}%   {conf} [{rel[1] * 100:.3f}%, {rel[2] * 100:.3f}%]")
+    print(f"{'Cohen d':<18}{d[0]:>14.3f}   {conf} [{d[1]:.3f}, {d[2]:.3f}]")
+    print(f"{'Cliff delta':<18}{res['cliff']:>14.3f}")
+
+
+def main(argv=None) -> None:
+    parser = argparse.ArgumentParser(prog="analyze.py", description="Energy, peak and mean power of many captures in parallel")
+    parser.add_argument("inputs", nargs="+", type=Path, help="Journals (.plj), CSV logs or directories holding them")
+    parser.add_argument("-o", "--out", type=Path, default=Path("summary.csv"), help="Summary table (default: summary.csv)")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="Worker processes (default: all cores)")
+    parser.add_argument("--rails", type=int, default=2, help="Power columns of CSV logs after the time column(s) (default: 2, PS and PL)")
+    parser.add_argument("--time64", action="store_true", help="CSV logs were captured with --time64 (two ns time columns)")
+    parser.add_argument("--baseline", nargs="+", type=Path, metavar="PATH",
+                        help="Compare the per-segment energy of the inputs against these captures instead of writing a summary")
+    parser.add_argument("--resamples", type=int, default=10000, help="With --baseline, bootstrap resamples (default: 10000)")
+    parser.add_argument("--alpha", type=float, default=0.05, help="With --baseline, 1 - confidence of the intervals (default: 0.05)")
+    parser.add_argument("--threshold", type=float, default=0.0, metavar="PCT",
+                        help="With --baseline, flag a regression when energy rose by more than PCT percent (default: 0)")
+    parser.add_argument("--seed", type=int, default=0, help="With --baseline, bootstrap random seed (default: 0)")
+    args = parser.parse_args(argv)
+
+    if args.baseline:
+        sys.exit(run_compare(args))
+
+    # Skip an earlier summary written among the captures
+    files = [p for p in find_captures(args.inputs) if p != args.out.resolve()]
+    if not files:
+        sys.exit("[ERROR]: No captures found.")
+
+    # Journals carry their own layout, these only apply to CSV logs
+    time_cols, tick_s = (2, 1e-9) if args.time64 else (1, 1e-6)
+    jobs = [(path, time_cols, args.rails, tick_s) for path in files]
+
+    # Each worker streams one file at a time, so memory is bounded by the
+    # number of workers, not by the size of the batch
+    with Pool(min(args.jobs, len(files))) as pool, args.out.open("w", newline="", encoding="utf-8") as f:
+        writer = csv.writer(f)
+        writer.writerow(SUMMARY_HEADER)
+        for rows in pool.imap(summarize, jobs):
+            writer.writerows(rows)
+            if rows and rows[0][1] == "error":
+                print(f"[WARN]: {rows[0][-1]}")
+
+    print(f"[INFO]: Summarised {len(files)} captures -> {args.out}")
+
+
+def run_compare(args) -> int:
+    time_cols, tick_s = (2, 1e-9) if args.time64 else (1, 1e-6)
+    sets = []
+    with Pool(args.jobs) as pool:
+        for paths in (args.baseline, args.inputs):
+            files = find_captures(paths)
+            jobs = [(path, time_cols, args.rails, tick_s) for path in files]
+            sets.append([e for part in pool.imap(segment_energies, jobs) for e in part])
+            if len(sets[-1]) < 2:
+                print(f"[ERROR]: Need at least 2 segments per set, got {len(sets[-1])} from {len(files)} captures")
+                return 2
+
+        res = compare(pool, sets[0], sets[1], args.resamples, args.alpha, args.seed)
+
+    print_comparison(res, args.alpha)
+    rel_lo, rel_hi = res["rel"][1] * 100, res["rel"][2] * 100
+    if rel_lo > args.threshold:
+        print(f"[WARN]: Energy regression: +{rel_lo:.3f}% at least, above the {args.threshold:g}% threshold")
+        return 1
+    if rel_hi < -args.threshold:
+        print(f"[INFO]: Energy improvement: {rel_hi:.3f}% at most")
+    else:
+        print("[INFO]: No significant regression")
+    return 0
+
+
+if __name__ == "__main__":
+    main()
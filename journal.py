@@ -0,0 +1,491 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Copyright © 2025 Christian Conti, Alessandro Varaldi
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the Licence, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https:#www.gnu.org/licenses/>.
+
+"""Append-only capture journal.
+
+Layout (little endian):
+
+    file   := MAGIC block*
+    block  := u32 length, u32 crc32(payload), payload[length]
+    payload:= u8 type, body
+
+BLOCK_ROWS bodies are tab-separated rows joined by newlines; BLOCK_LINE
+bodies are one device or logger event line ('#START', '#ALERT ...', ...).
+Blocks are only ever appended, so a crash can at worst leave one torn block
+at the tail. `recover` finds it in one sequential pass, truncates the file
+there and rebuilds the `.idx` sidecar that a clean close writes.
+
+The journal of a session holds all of its trigger windows. The index lists
+the blocks (offset, rows before it, type) and the segments, one per
+'#START'..'#STOP' window or, without a trigger, one for the whole run: ID,
+first/last device timestamp, first row and row count, offset of the first
+block and the energy and peak power over all rails. `Session` maps the file
+once and reads any segment in place from its offset.
+"""
+
+import argparse
+import csv
+import mmap
+import os
+import struct
+import sys
+import time
+import zlib
+from collections import namedtuple
+from pathlib import Path
+
+MAGIC = b"PLJ\x01"
+BLOCK_HDR = struct.Struct("<II")
+BLOCK_ROWS = 1
+BLOCK_LINE = 2
+# Largest payload a writer produces; anything above marks a torn length
+MAX_BLOCK = 1 << 20
+
+INDEX_MAGIC = b"PLX\x03"
+INDEX_HDR = struct.Struct("<QII")        # journal size covered, blocks, segments
+INDEX_ENTRY = struct.Struct("<QQB")      # block offset, rows before it, type
+SEG_ENTRY = struct.Struct("<IqqQQQdd")   # see Segment
+
+# t_start/t_end are device timestamps (µs, ns with --time64); µs stamps are
+# unwrapped past 2^32 within a segment, so t_end - t_start is its span.
+# offset is the first block of the segment
+Segment = namedtuple("Segment", "id t_start t_end first_row rows offset energy_j peak_w")
+
+# Rows are batched into one block per this many rows or seconds
+ROWS_PER_BLOCK = 256
+FLUSH_S = 0.25
+# Interval between fsync() calls, bounding what power loss can take
+SYNC_S = 1.0
+
+
+def index_path(path: Path) -> Path:
+    return path.with_name(path.name + ".idx")
+
+
+class SegmentBuilder:
+    """Build the segment table from the record stream, as it is written or
+    while scanning. Also usable on plain CSV rows: set the column layout and
+    feed row() only, everything then lands in one segment."""
+
+    def __init__(self, time_cols: int = 1, rails: int = None, tick_s: float = 1e-6) -> None:
+        self.time_cols = time_cols
+        self.rails = rails
+        self.tick_s = tick_s
+        self.table = []
+        self.cur = None
+        self.last = None
+
+    def line(self, offset: int, row: int, text: str) -> None:
+        fields = text.split("\t")
+        if fields[0] == "#SESSION":
+            self.time_cols, self.rails, self.tick_s = int(fields[1]), int(fields[2]), float(fields[3])
+        elif fields[0] == "#START":
+            self.close()
+            self._open(offset, row)
+        elif fields[0] == "#STOP":
+            self.close()
+        elif fields[0] == "#GAP" and self.cur is not None:
+            # The device clock may have restarted, do not integrate across
+            self.cur[-1] = None
+
+    def row(self, offset: int, row: int, values: list) -> None:
+        if self.cur is None:
+            self._open(offset, row)
+        cur = self.cur
+        cur[4] += 1
+        end = None if self.rails is None else self.time_cols + self.rails
+        try:
+            t = self._unwrap(int(values[0]))
+            pwr = sum(float(v) for v in values[self.time_cols:end] if v)
+        except ValueError:
+            return
+        if cur[1] is None:
+            cur[1] = t
+        cur[2] = t
+        # Rectangle rule: each record holds until the next one
+        prev = cur[-1]
+        if prev is not None and t > prev[0]:
+            cur[6] += prev[1] * (t - prev[0]) * self.tick_s
+        cur[7] = max(cur[7], pwr)
+        cur[-1] = (t, pwr)
+
+    def close(self) -> None:
+        if self.cur is not None:
+            self.table.append(self._entry(self.cur))
+            self.cur = None
+
+    def _open(self, offset: int, row: int) -> None:
+        # id, t_start, t_end, first_row, rows, offset, energy, peak, last (t, pwr)
+        self.cur = [len(self.table), None, None, row, 0, offset, 0.0, 0.0, None]
+        self.last = None
+
+    def _unwrap(self, t: int) -> int:
+        # 32-bit µs stamps wrap every 71.6 min; ns stamps are 64-bit
+        if self.time_cols != 1:
+            return t
+        wrap = 1 << 32
+        if self.last is not None:
+            raw, unwrapped = self.last
+            # Nearest value to the previous stamp, stamps may step back a little
+            step = (t - raw) % wrap
+            t = unwrapped + (step - wrap if step >= wrap // 2 else step)
+        self.last = (t % wrap, t)
+        return t
+
+    def finish(self) -> list:
+        """Table including the segment still open."""
+        return self.table + ([self._entry(self.cur)] if self.cur is not None else [])
+
+    @staticmethod
+    def _entry(cur: list) -> Segment:
+        return Segment(cur[0], cur[1] or 0, cur[2] or 0, *cur[3:8])
+
+
+class JournalWriter:
+    """Append rows and event lines; close() writes the index.
+
+    `time_cols`, `rails` and `tick_s` (seconds per device time unit) describe
+    the rows, so the segment energy can be computed while writing.
+    """
+
+    def __init__(self, path: Path, time_cols: int = 1, rails: int = None, tick_s: float = 1e-6) -> None:
+        self.path = path
+        self.f = path.open("ab")
+        if self.f.tell() == 0:
+            self.f.write(MAGIC)
+            self.entries, self.rows, self.segments = [], 0, SegmentBuilder()
+        else:
+            # Continue a recovered journal, never write past a torn tail
+            end, self.entries, self.rows, self.segments = scan(path)
+            self.f.truncate(end)
+            # truncate() leaves the position, and so tell(), at the old size
+            self.f.seek(end)
+        self.pending = []
+        self.last_flush = time.monotonic()
+        self.last_sync = self.last_flush
+        self.unsynced = False
+        if rails is not None:
+            self.add_line(f"#SESSION\t{time_cols}\t{rails}\t{tick_s:g}")
+
+    def add_row(self, values: list) -> None:
+        # Pending rows land in the next block, at the current end of file
+        self.segments.row(self.f.tell(), self.rows + len(self.pending), values)
+        self.pending.append("\t".join(values))
+        if len(self.pending) >= ROWS_PER_BLOCK or time.monotonic() - self.last_flush >= FLUSH_S:
+            self.flush()
+
+    def add_line(self, line: str) -> None:
+        # Keep rows and events in arrival order
+        self.flush()
+        self.segments.line(self.f.tell(), self.rows, line)
+        self._append(BLOCK_LINE, line.encode())
+
+    def poll(self) -> None:
+        """Flush and fsync on time while no rows arrive, e.g. when a serial
+        read times out, so the last rows before a pause reach the disk."""
+        now = time.monotonic()
+        if self.pending and now - self.last_flush >= FLUSH_S:
+            self.flush()
+        if self.unsynced and now - self.last_sync >= SYNC_S:
+            self._sync()
+
+    def flush(self) -> None:
+        self.last_flush = time.monotonic()
+        if not self.pending:
+            return
+        rows = len(self.pending)
+        self._append(BLOCK_ROWS, "\n".join(self.pending).encode(), rows)
+        self.pending = []
+
+    def close(self) -> None:
+        self.flush()
+        self.f.flush()
+        os.fsync(self.f.fileno())
+        write_index(self.path, self.f.tell(), self.entries, self.segments.finish())
+        self.f.close()
+
+    def _append(self, kind: int, body: bytes, rows: int = 0) -> None:
+        payload = bytes((kind,)) + body
+        self.entries.append((self.f.tell(), self.rows, kind))
+        self.rows += rows
+        # One write per block: a crash tears at most the block in flight
+        self.f.write(BLOCK_HDR.pack(len(payload), zlib.crc32(payload)) + payload)
+        self.f.flush()
+        self.unsynced = True
+        if time.monotonic() - self.last_sync >= SYNC_S:
+            self._sync()
+
+    def _sync(self) -> None:
+        os.fsync(self.f.fileno())
+        self.last_sync = time.monotonic()
+        self.unsynced = False
+
+
+def _blocks(buf, start: int = len(MAGIC)):
+    """Yield (offset, type, body) of each intact block, stopping at the first
+    torn or corrupt one."""
+    off = start
+    size = len(buf)
+    while off + BLOCK_HDR.size <= size:
+        length, crc = BLOCK_HDR.unpack_from(buf, off)
+        end = off + BLOCK_HDR.size + length
+        if length == 0 or length > MAX_BLOCK or end > size:
+            return
+        payload = buf[off + BLOCK_HDR.size:end]
+        if zlib.crc32(payload) != crc:
+            return
+        yield off, payload[0], payload[1:]
+        off = end
+
+
+def _open_map(path: Path):
+    f = path.open("rb")
+    if os.fstat(f.fileno()).st_size < len(MAGIC):
+        f.close()
+        raise ValueError(f"{path}: not a journal")
+    mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    f.close()
+    if mm[:len(MAGIC)] != MAGIC:
+        mm.close()
+        raise ValueError(f"{path}: not a journal")
+    return mm
+
+
+def scan(path: Path) -> tuple:
+    """Return (end of the last intact block, index entries, row count,
+    segment builder)."""
+    mm = _open_map(path)
+    entries = []
+    segments = SegmentBuilder()
+    rows = 0
+    end = len(MAGIC)
+    for off, kind, body in _blocks(mm):
+        entries.append((off, rows, kind))
+        text = body.decode(errors="replace")
+        if kind == BLOCK_ROWS:
+            for line in text.split("\n"):
+                segments.row(off, rows, line.split("\t"))
+                rows += 1
+        elif kind == BLOCK_LINE:
+            segments.line(off, rows, text)
+        end = off + BLOCK_HDR.size + 1 + len(body)
+    mm.close()
+    return end, entries, rows, segments
+
+
+def write_index(path: Path, size: int, entries: list, segments: list) -> None:
+    tmp = index_path(path).with_suffix(".tmp")
+    with tmp.open("wb") as f:
+        f.write(INDEX_MAGIC + INDEX_HDR.pack(size, len(entries), len(segments)))
+        f.write(b"".join(INDEX_ENTRY.pack(*e) for e in entries))
+        f.write(b"".join(SEG_ENTRY.pack(*s) for s in segments))
+    # Atomic swap, a reader never sees a half-written index
+    os.replace(tmp, index_path(path))
+
+
+def read_index(path: Path):
+    """(block entries, segments) of an index that still matches the journal,
+    else None."""
+    try:
+        data = index_path(path).read_bytes()
+    except OSError:
+        return None
+    base = len(INDEX_MAGIC) + INDEX_HDR.size
+    if len(data) < base or data[:len(INDEX_MAGIC)] != INDEX_MAGIC:
+        return None
+    size, n, n_seg = INDEX_HDR.unpack_from(data, len(INDEX_MAGIC))
+    seg_base = base + n * INDEX_ENTRY.size
+    if size != path.stat().st_size or len(data) != seg_base + n_seg * SEG_ENTRY.size:
+        return None
+    entries = list(INDEX_ENTRY.iter_unpack(data[base:seg_base]))
+    return entries, [Segment(*s) for s in SEG_ENTRY.iter_unpack(data[seg_base:])]
+
+
+def recover(path: Path) -> tuple:
+    """Truncate a torn tail and rebuild the index.
+
+    Returns (bytes dropped, blocks kept, rows kept).
+    """
+    end, entries, rows, segments = scan(path)
+    size = path.stat().st_size
+    if end < size:
+        with path.open("r+b") as f:
+            f.truncate(end)
+            f.flush()
+            os.fsync(f.fileno())
+    write_index(path, end, entries, segments.finish())
+    return size - end, len(entries), rows
+
+
+class Session:
+    """Read-only view of a journal: one mmap and the segment table.
+
+    The table comes from the index, or from a scan when the index is missing
+    or stale (the journal is left untouched, use recover() to fix it).
+    """
+
+    def __init__(self, path: Path) -> None:
+        self.path = path
+        index = read_index(path)
+        self.segments = index[1] if index else scan(path)[3].finish()
+        self.mm = _open_map(path)
+        # Seconds per device time unit, from the #SESSION line written first
+        self.tick_s = 1e-6
+        for _, kind, body in _blocks(self.mm):
+            if kind == BLOCK_LINE and body.startswith(b"#SESSION\t"):
+                self.tick_s = float(body.split(b"\t")[3])
+            break
+
+    def rows(self, seg: Segment):
+        """Yield the rows of `seg` as lists of fields."""
+        left = seg.rows
+        for _, kind, body in _blocks(self.mm, seg.offset):
+            if left == 0:
+                return
+            if kind != BLOCK_ROWS:
+                continue
+            for line in body.decode(errors="replace").split("\n")[:left]:
+                yield line.split("\t")
+                left -= 1
+
+    def close(self) -> None:
+        self.mm.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+
+def records(path: Path):
+    """Yield ('row', fields) and ('line', text) in capture order."""
+    mm = _open_map(path)
+    for _, kind, body in _blocks(mm):
+        text = body.decode(errors="replace")
+        if kind == BLOCK_ROWS:
+            for row in text.split("\n"):
+                yield "row", row.split("\t")
+        elif kind == BLOCK_LINE:
+            yield "line", text
+    mm.close()
+
+
+def export(path: Path, out_dir: Path) -> list:
+    """Write the journal back out as the CSV files power_log.py would have
+    produced: one per trigger window, or a single one without windows, plus
+    the events. Returns the paths written."""
+    out_dir.mkdir(parents=True, exist_ok=True)
+    stem = path.stem
+    written = []
+    f = writer = None
+    width = 0
+    events = None
+
+    def open_csv(p: Path):
+        written.append(p)
+        return p.open("w", newline="", encoding="utf-8")
+
+    try:
+        for kind, item in records(path):
+            if kind == "line":
+                fields = item.split("\t")
+                if fields[0] == "#START":
+                    if f:
+                        f.close()
+                    f = open_csv(out_dir / f"{stem}_{fields[1] if len(fields) > 1 else len(written)}.csv")
+                    writer, width = csv.writer(f), 0
+                elif fields[0] == "#STOP":
+                    if f:
+                        f.close()
+                    f = writer = None
+                else:
+                    if events is None:
+                        events = open_csv(out_dir / f"{stem}_events.csv")
+                        ev_writer = csv.writer(events)
+                        ev_writer.writerow(["event", "fields..."])
+                    ev_writer.writerow([fields[0].lstrip("#")] + fields[1:])
+                continue
+
+            if writer is None:
+                f = open_csv(out_dir / f"{stem}.csv")
+                writer, width = csv.writer(f), 0
+            if len(item) > width:
+                width = len(item)
+                writer.writerow([f"value{i+1}" for i in range(width)])
+            writer.writerow(item + [""] * (width - len(item)))
+    finally:
+        if f:
+            f.close()
+        if events:
+            events.close()
+    return written
+
+
+def export_segment(path: Path, seg_id: int, out_dir: Path) -> Path:
+    """Write one segment to `<stem>_seg<ID>.csv`."""
+    out_dir.mkdir(parents=True, exist_ok=True)
+    with Session(path) as session:
+        if not 0 <= seg_id < len(session.segments):
+            raise ValueError(f"{path}: no segment {seg_id} ({len(session.segments)} segments)")
+        out = out_dir / f"{path.stem}_seg{seg_id}.csv"
+        rows = list(session.rows(session.segments[seg_id]))
+    width = max((len(r) for r in rows), default=0)
+    with out.open("w", newline="", encoding="utf-8") as f:
+        writer = csv.writer(f)
+        writer.writerow([f"value{i+1}" for i in range(width)])
+        writer.writerows(r + [""] * (width - len(r)) for r in rows)
+    return out
+
+
+def print_segments(path: Path) -> None:
+    with Session(path) as session:
+        print(f"{'ID':>6} {'t_start':>14} {'t_end':>14} {'rows':>9} {'energy [J]':>12} {'peak [W]':>9}")
+        for s in session.segments:
+            print(f"{s.id:>6} {s.t_start:>14} {s.t_end:>14} {s.rows:>9} {s.energy_j:>12.6f} {s.peak_w:>9.4f}")
+
+
+def main(argv=None) -> None:
+    parser = argparse.ArgumentParser(prog="journal.py", description="Recover and export power_log.py journals (.plj)")
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    p_rec = sub.add_parser("recover", help="Truncate torn tails and rebuild the index")
+    p_rec.add_argument("journals", nargs="+", type=Path)
+    p_seg = sub.add_parser("segments", help="List the segments of a journal")
+    p_seg.add_argument("journal", type=Path)
+    p_exp = sub.add_parser("export", help="Write a journal out as CSV files")
+    p_exp.add_argument("journal", type=Path)
+    p_exp.add_argument("-o", "--out", type=Path, help="Output directory (default: next to the journal)")
+    p_exp.add_argument("--segment", type=int, metavar="ID", help="Only write this segment, to <journal>_seg<ID>.csv")
+    args = parser.parse_args(argv)
+
+    try:
+        if args.cmd == "recover":
+            for path in args.journals:
+                dropped, blocks, rows = recover(path)
+                print(f"[INFO]: {path}: {blocks} blocks, {rows} rows kept, {dropped} torn bytes dropped")
+        elif args.cmd == "segments":
+            print_segments(args.journal)
+        elif args.segment is not None:
+            print(f"[INFO]: Wrote {export_segment(args.journal, args.segment, args.out or args.journal.parent)}")
+        else:
+            for p in export(args.journal, args.out or args.journal.parent):
+                print(f"[INFO]: Wrote {p}")
+    except (OSError, ValueError) as exc:
+        sys.exit(f"[ERROR]: {exc}")
+
+
+if __name__ == "__main__":
+    main()
@@ -15,16 +15,31 @@
 # along with this program.  If not, see <https:#www.gnu.org/licenses/>.
 
 import argparse
+import base64
+import bisect
 import csv
 import subprocess
 import sys
 import time
 import serial
 from serial.tools import list_ports
+from collections import deque
 from datetime import datetime
 from pathlib import Path
 
+from journal import JournalWriter
+
 UPLOAD_DELAY = 2
+# Pause between reconnection attempts
+RECONNECT_DELAY = 1
+# Serial read timeout, so the journal still flushes while the device is quiet
+READ_TIMEOUT_S = 0.1
+HIST_SUB_BITS = 4
+# Shunt-only records held back at most while waiting for bus voltages
+VBUS_MAX_PENDING = 100_000
+# Records held back at most while waiting for the #WIN line of their window
+WIN_MAX_PENDING = 100_000
+HIST_QUANTILES = (0.5, 0.99, 0.999)
 BAUD = 2_000_000
 SPINNER = ["|", "/", "-", "\\"]
 
@@ -59,6 +74,46 @@ def compile_sketch(**kwargs) -> None:
 
     flags = f"-DBOARD_{target_board} "
     flags += "-DEXT_TRIGGER " if kwargs["ext_trigger"] else ""
+    flags += f"-DTRIG_MIN_US={kwargs['trig_min_us']} " if kwargs["trig_min_us"] else ""
+    flags += f"-DTRIG_COALESCE_US={kwargs['trig_coalesce_us']} " if kwargs["trig_coalesce_us"] else ""
+    flags += f"-DTRIG_BATCH={kwargs['trig_batch']} " if kwargs["trig_batch"] else ""
+    flags += f"-DWINDOW_STATS -DWSTAT_EVERY_MS={kwargs['window_stats']} " if kwargs["window_stats"] else ""
+    flags += "-DDUAL_BUS " if kwargs["dual_bus"] else ""
+    flags += "-DASYNC_I2C " if kwargs["async_i2c"] else ""
+    flags += "-DRTOS_ACQ " if kwargs["rtos"] else ""
+    flags += "-DFIXED_TEXT " if kwargs["fixed_text"] else ""
+    flags += "-DCOMPRESS " if kwargs["compress"] else ""
+    flags += "-DAUTO_RAILS " if kwargs["auto_rails"] else ""
+    flags += "-DPROFILES " if kwargs["profiles"] else ""
+    flags += "-DTIME64 " if kwargs["time64"] else ""
+    if kwargs["ext_clock"] is not None:
+        flags += f"-DEXT_CLOCK -DEXT_CLOCK_DIV={kwargs['ext_clock']} "
+        flags += f"-DEXT_CLOCK_PIN={kwargs['clock_pin']} " if kwargs["clock_pin"] is not None else ""
+    if kwargs["sync"] or kwargs["sync_master"]:
+        flags += "-DSYNC_PULSE "
+        flags += f"-DSYNC_MASTER -DSYNC_PERIOD_MS={kwargs['sync_period_ms']} " if kwargs["sync_master"] else ""
+        flags += f"-DSYNC_PIN={kwargs['sync_pin']} " if kwargs["sync_pin"] is not None else ""
+    flags += f"-DSHUNT_ONLY -DVBUS_EVERY_MS={kwargs['vbus_ms']} " if kwargs["shunt_only"] else ""
+    if kwargs["adaptive"]:
+        flags += (f"-DADAPTIVE_RATE -DADAPT_FAST_US={kwargs['fast_us']} -DADAPT_SLOW_US={kwargs['slow_us']} "
+                  f"-DADAPT_DELTA_LSB={kwargs['activity_lsb']} -DADAPT_VAR_LSB2={kwargs['activity_var']} "
+                  f"-DADAPT_HOLD_MS={kwargs['hold_ms']} ")
+    if kwargs["pmbus"]:
+        flags += f"-DPMBUS_RAILS={len(kwargs['pmbus'])} "
+        flags += "".join(f"-DPMBUS_RAIL{i}={(addr << 8) | page:#06x} " for i, (addr, page) in enumerate(kwargs["pmbus"]))
+        flags += "-DPMBUS_PEC " if kwargs["pmbus_pec"] else ""
+    if kwargs["pwr_limit_ps"] or kwargs["pwr_limit_pl"]:
+        flags += f"-DPOWER_ALERT -DPWR_LIMIT_PS_W={kwargs['pwr_limit_ps'] or 0} -DPWR_LIMIT_PL_W={kwargs['pwr_limit_pl'] or 0} "
+        flags += f"-DTHROTTLE_PIN={kwargs['throttle_pin']} " if kwargs["throttle_pin"] is not None else ""
+    if kwargs["histogram"] is not None:
+        flags += f"-DHISTOGRAM -DHIST_WINDOW_MS={kwargs['histogram']} "
+    if kwargs["filter"]:
+        flags += f"-DFILTER -DFILTER_{kwargs['filter'].upper()} -DDECIMATE={kwargs['decimate']} "
+        flags += f"-DFILTER_TAPS={kwargs['taps']} " if kwargs["taps"] else ""
+    if kwargs["deadband"] is not None:
+        flags += f"-DDEADBAND -DDEADBAND_LSB={kwargs['deadband']} -DHEARTBEAT_MS={kwargs['heartbeat_ms']} "
+    flags += f"-DTX_FLUSH_US={kwargs['flush_us']} " if kwargs["flush_us"] else ""
+    flags += f"-DSAMPLE_PERIOD_US={kwargs['period_us']} " if kwargs["period_us"] else ""
 
     cmd = ["arduino-cli", "compile", "--fqbn", arduino_board,
         "--build-property", f"build.extra_flags={flags}",
@@ -84,7 +139,461 @@ def _write_header(writer: csv.writer, field_count: int) -> None:
     writer.writerow([f"value{i+1}" for i in range(field_count)])
 
 
-def read_serial_and_log(port: str, csv_path: Path, ext_trigger: bool = False) -> None:
+def _read_lines(ser: serial.Serial, idle=None):
+    """Yield raw lines, reading whatever the device has sent in one call.
+
+    The firmware batches output into whole USB packets; reading them in bulk
+    avoids a readline() round-trip per sample on the host as well. `idle` is
+    called whenever a read times out without data.
+    """
+    pending = b""
+    while True:
+        chunk = ser.read(ser.in_waiting or 1)
+        if not chunk:
+            if idle:
+                idle()
+            continue
+        lines = (pending + chunk).split(b"\n")
+        pending = lines.pop()
+        yield from lines
+
+
+class SideLog:
+    """CSV written next to the main log, created on its first row."""
+
+    def __init__(self, path: Path, header: list) -> None:
+        self.path = path
+        self.header = header
+        self.f = None
+        self.writer = None
+
+    def writerow(self, row: list) -> None:
+        if self.writer is None:
+            self.f = self.path.open("a", newline="", encoding="utf-8")
+            self.writer = csv.writer(self.f)
+            if self.f.tell() == 0:
+                self.writer.writerow(self.header)
+        self.writer.writerow(row)
+        self.f.flush()
+
+    def close(self) -> None:
+        if self.f is not None:
+            self.f.close()
+            self.f = None
+            self.writer = None
+
+
+RAIL_NAMES = ("PS", "PL")
+
+
+def rail_name(rail: int) -> str:
+    """INA226 rails by name, PMBus rails as PMBUS<n> in column order."""
+    return RAIL_NAMES[rail] if rail < len(RAIL_NAMES) else f"PMBUS{rail - len(RAIL_NAMES)}"
+
+
+def _pmbus_rail(spec: str) -> tuple:
+    """Parse ADDR[:PAGE], e.g. 0x13:1."""
+    addr, _, page = spec.partition(":")
+    return int(addr, 0), int(page or "0", 0)
+
+
+def _handle_event(line: str, events: SideLog) -> None:
+    """Record '#'-prefixed device events other than the trigger markers."""
+    fields = line.split("\t")
+    if fields[0] == "#SYNC":
+        # Arrival time, to pair the same pulse across loggers (align.py)
+        fields.append(datetime.now().isoformat(timespec="milliseconds"))
+    events.writerow([fields[0][1:]] + fields[1:])
+    if fields[0] == "#DROP":
+        print(f"\n[WARN]: Device lost {fields[1]} records so far")
+    elif fields[0] == "#ALERTLOST":
+        print(f"\n[WARN]: Device lost {fields[1]} alert edges so far")
+    elif fields[0] == "#ALERT" and fields[3] == "1":
+        print(f"\n[WARN]: {rail_name(int(fields[2]))} over power limit at t={fields[1]} us")
+    elif fields[0] == "#PMBUS" and fields[4] != "1":
+        print(f"\n[WARN]: No PMBus telemetry at 0x{int(fields[2]):02X} page {fields[3]}, {rail_name(int(fields[1]))} reads -1")
+    elif fields[0] == "#ERR":
+        print(f"\n[WARN]: Device rejected command '{fields[1]}'")
+    elif fields[0] == "#BANNER":
+        print(f"\n[INFO]: {fields[1]} with profile '{fields[2]}'")
+    elif fields[0] == "#RAIL":
+        print(f"\n[INFO]: {rail_name(int(fields[1]))} rail on mux channel {fields[2]}, address 0x{int(fields[3]):02X}")
+    elif verbose:
+        print(f"\n[INFO]: Device event {line}")
+
+
+INA_AVG = (1, 4, 16, 64, 128, 256, 512, 1024)
+INA_CT_US = (140, 204, 332, 588, 1100, 2116, 4156, 8244)
+
+
+def device_command(port: str, commands: list, wait: float = 1.0) -> list:
+    """Send commands to the running firmware, return its '#' replies."""
+    replies = []
+    pending = b""
+    with serial.Serial(port, BAUD, timeout=0.1) as ser:
+        ser.reset_input_buffer()
+        for cmd in commands:
+            ser.write(f"{cmd}\n".encode())
+        deadline = time.monotonic() + wait
+        while time.monotonic() < deadline:
+            *lines, pending = (pending + ser.read(ser.in_waiting or 1)).split(b"\n")
+            replies += [l.decode(errors="replace").rstrip() for l in lines
+                        if l.startswith((b"#PROFILE", b"#BANNER", b"#ERR"))]
+    return replies
+
+
+def print_profiles(replies: list) -> None:
+    for line in replies:
+        fields = line.split("\t")
+        if fields[0] == "#ERR":
+            print(f"[ERROR]: Device rejected '{fields[1]}'")
+        elif fields[0] == "#PROFILE":
+            name, active, board, config, period_us, trigger, limit_ps, limit_pl = fields[1:9]
+            config = int(config, 16)
+            print(f"{'*' if active == '1' else ' '} {name:<16} {board}  avg={INA_AVG[(config >> 9) & 7]} "
+                  f"ct_us={INA_CT_US[(config >> 3) & 7]} period_us={period_us} trigger={trigger} "
+                  f"limit_ps={limit_ps} limit_pl={limit_pl}")
+
+
+def _step_hold(values: list, last: dict, time_cols: int = 1) -> list:
+    """Fill rails the device left empty with their last value.
+
+    Appends a bit mask column where bit i is set if rail i was held.
+    """
+    held = 0
+    for i, value in enumerate(values[time_cols:]):
+        if value == "":
+            values[i + time_cols] = last.get(i, "")
+            held |= 1 << i
+        else:
+            last[i] = value
+    return values + [str(held)]
+
+
+def _unzigzag(val: int) -> int:
+    return (val >> 1) ^ -(val & 1)
+
+
+class DeltaDecoder:
+    """Decode '#BLK' lines sent by firmware built with --compress.
+
+    Mirrors the block layout documented in src/DeltaCoder.h. Blocks that
+    follow a lost one (sequence gap) are dropped until the next keyframe.
+    `lsb_scale` turns the LSBs of the keyframes into units: shunt-only
+    firmware sends them in nW/nA.
+    """
+
+    RICE_ESCAPE = 24
+
+    def __init__(self, lsb_scale: float = 1e-6) -> None:
+        self.lsb_scale = lsb_scale
+        self.lost = 0
+        self.reset()
+
+    def reset(self) -> None:
+        self.synced = False
+        self.seq = 0
+        self.t = 0
+        self.dt = 0
+        self.raw = []
+        self.lsb_uw = []
+
+    def decode(self, payload: str) -> list:
+        """Return the block as rows of CSV fields: timestamp, then watts per rail."""
+        data = base64.b64decode(payload)
+        bits = format(int.from_bytes(data, "big"), f"0{len(data) * 8}b")
+        pos = 0
+
+        def take(n: int) -> int:
+            nonlocal pos
+            val = int(bits[pos:pos + n], 2) if n else 0
+            pos += n
+            return val
+
+        def varint() -> int:
+            val, shift = 0, 0
+            while True:
+                byte = take(8)
+                val |= (byte & 0x7f) << shift
+                shift += 7
+                if byte < 0x80:
+                    return val
+
+        def rice(k: int) -> int:
+            nonlocal pos
+            stop = bits.find("0", pos, pos + self.RICE_ESCAPE)
+            if stop < 0:
+                pos += self.RICE_ESCAPE
+                return take(32)
+            q = stop - pos
+            pos = stop + 1
+            return (q << k) | take(k)
+
+        seq, flags, rails, count = take(8), take(8), take(8), take(8)
+        if flags & 1:
+            self.t = varint()
+            self.dt = 0
+            self.raw = [_unzigzag(varint()) for _ in range(rails)]
+            self.lsb_uw = [varint() for _ in range(rails)]
+        elif not self.synced or seq != (self.seq + 1) & 0xff:
+            self.synced = False
+            self.lost += 1
+            if verbose:
+                print(f"\n[WARN]: Dropped compressed block {seq}, waiting for keyframe")
+            return []
+        self.synced = True
+        self.seq = seq
+
+        k = [take(8) for _ in range(rails + 1)]
+        rows = []
+        for _ in range(count):
+            self.dt = (self.dt + _unzigzag(rice(k[0]))) & 0xffffffff
+            self.t = (self.t + self.dt) & 0xffffffff
+            for i in range(rails):
+                self.raw[i] += _unzigzag(rice(k[i + 1]))
+            rows.append([str(self.t)] + [f"{r * l * self.lsb_scale:.6f}" for r, l in zip(self.raw, self.lsb_uw)])
+        return rows
+
+
+class VbusRebuild:
+    """Turn the currents of shunt-only records into power: each rail's
+    current times its bus voltage, interpolated linearly between the #VBUS
+    samples around the record. Records wait until every rail has a sample
+    past them; flush() releases the rest with the last voltage held.
+
+    The 32-bit micros() stamps are unwrapped against the last one seen, so
+    the interpolation keeps working past the ~71.6 min wrap."""
+
+    def __init__(self, rails: int, time_cols: int = 1) -> None:
+        self.rails = rails
+        self.time_cols = time_cols
+        # The 32-bit micros() stamps wrap, the nanosecond ones do not
+        self.wrap = 1 << 32 if time_cols == 1 else None
+        self.points = [[] for _ in range(rails)]    # (t, volts), by unwrapped time
+        self.pending = deque()                      # (t, values), by unwrapped time
+        self.last = None                            # (raw, unwrapped) of the latest stamp
+
+    def add(self, line: str) -> None:
+        """#VBUS <t> <rail> <uV>, uV is -1 on a failed conversion."""
+        _, t, rail, uv = line.split("\t")
+        t = self._unwrap(int(t))
+        if int(uv) >= 0 and int(rail) < self.rails:
+            self.points[int(rail)].append((t, int(uv) * 1e-6))
+
+    def push(self, rows: list) -> list:
+        self.pending.extend((self._unwrap(int(values[0])), values) for values in rows)
+        ready = []
+        while self.pending:
+            t = self.pending[0][0]
+            if len(self.pending) < VBUS_MAX_PENDING and any(not p or p[-1][0] < t for p in self.points):
+                break
+            ready.append(self._power(*self.pending.popleft()))
+        self._prune()
+        return ready
+
+    def flush(self) -> list:
+        ready = [self._power(t, values) for t, values in self.pending]
+        self.pending.clear()
+        return ready
+
+    def reset(self) -> None:
+        """Forget the voltages, e.g. when the device clock restarts."""
+        self.points = [[] for _ in range(self.rails)]
+        self.last = None
+
+    def _unwrap(self, t: int) -> int:
+        if self.wrap is None:
+            return t
+        if self.last is not None:
+            raw, unwrapped = self.last
+            # Nearest value to the previous stamp, stamps may step back a little
+            step = (t - raw) % self.wrap
+            t = unwrapped + (step - self.wrap if step >= self.wrap // 2 else step)
+            self.last = (t % self.wrap, t)
+        else:
+            self.last = (t, t)
+        return t
+
+    def _volts(self, rail: int, t: int):
+        pts = self.points[rail]
+        if not pts:
+            return None
+        i = bisect.bisect_left(pts, (t,))
+        if i == 0:
+            return pts[0][1]
+        if i == len(pts):
+            return pts[-1][1]
+        (t0, v0), (t1, v1) = pts[i - 1], pts[i]
+        return v0 + (v1 - v0) * (t - t0) / (t1 - t0)
+
+    def _power(self, t: int, values: list) -> list:
+        for rail in range(self.rails):
+            col = self.time_cols + rail
+            if col < len(values) and values[col]:
+                volts = self._volts(rail, t)
+                values[col] = f"{float(values[col]) * volts:.6f}" if volts is not None else ""
+        return values
+
+    def _prune(self) -> None:
+        # Keep the last sample at or before the oldest record still waiting
+        t = self.pending[0][0] if self.pending else None
+        for rail, pts in enumerate(self.points):
+            keep = len(pts) - 1 if t is None else bisect.bisect_left(pts, (t,)) - 1
+            if keep > 0:
+                del pts[:keep]
+
+
+class WindowSplitter:
+    """Cut records into the trigger windows of batched '#WIN' lines: each
+    line lists the start and end of closed windows on the records' time
+    base, after their records. A window is cut once a record past its end
+    has arrived, so records still held back upstream (e.g. by VbusRebuild)
+    are not lost; flush() cuts the rest. Records outside every window are
+    dropped, and so are the oldest ones beyond WIN_MAX_PENDING, counted in
+    `overflow`."""
+
+    def __init__(self, time_cols: int = 1) -> None:
+        # The 32-bit micros() stamps wrap, the nanosecond ones do not
+        self.wrap = 1 << 32 if time_cols == 1 else None
+        self.pending = deque()
+        self.bounds = deque()
+        self.overflow = 0
+
+    def add(self, line: str) -> None:
+        """#WIN <start> <end> [<start> <end> ...]"""
+        bounds = [int(v) for v in line.split("\t")[1:]]
+        self.bounds.extend(zip(bounds[::2], bounds[1::2]))
+
+    def push(self, rows: list) -> list:
+        """Queue records, return the windows now complete as [(start, end, rows)]."""
+        self.pending.extend(rows)
+        while len(self.pending) > WIN_MAX_PENDING:
+            self.pending.popleft()
+            self.overflow += 1
+        return self._cut(False)
+
+    def flush(self) -> list:
+        """Cut every window announced so far, e.g. at a stream gap or on exit."""
+        windows = self._cut(True)
+        self.pending.clear()
+        return windows
+
+    def _cut(self, final: bool) -> list:
+        windows = []
+        while self.bounds:
+            start, end = self.bounds[0]
+            if not final and not (self.pending and self._before(end, int(self.pending[-1][0]))):
+                break
+            self.bounds.popleft()
+            while self.pending and self._before(int(self.pending[0][0]), start):
+                self.pending.popleft()
+            rows = []
+            while self.pending and not self._before(end, int(self.pending[0][0])):
+                rows.append(self.pending.popleft())
+            windows.append((start, end, rows))
+        return windows
+
+    def _before(self, a: int, b: int) -> bool:
+        if self.wrap is None:
+            return a < b
+        return 0 < (b - a) % self.wrap < self.wrap // 2
+
+
+def _wstat(line: str) -> tuple:
+    """'#WSTAT <quantity> <t> <count> <mean> <m2> <min> <max>' -> (quantity, t, (n, mean, m2, min, max))"""
+    _, quantity, t, n, mean, m2, lo, hi = line.split("\t")
+    return quantity, int(t), (int(n), float(mean), float(m2), float(lo), float(hi))
+
+
+def merge_stat(a: tuple, b: tuple) -> tuple:
+    """Combine two (n, mean, m2, min, max) aggregates (Chan et al.)."""
+    if a is None or a[0] == 0:
+        return b
+    n = a[0] + b[0]
+    delta = b[1] - a[1]
+    mean = a[1] + delta * b[0] / n
+    m2 = a[2] + b[2] + delta * delta * a[0] * b[0] / n
+    return n, mean, m2, min(a[3], b[3]), max(a[4], b[4])
+
+
+def _wstat_name(quantity: str) -> str:
+    if quantity.isdigit() and int(quantity) < len(RAIL_NAMES):
+        return RAIL_NAMES[int(quantity)]
+    return quantity
+
+
+def print_wstats(totals: dict) -> None:
+    """Per-invocation duration and energy over the whole session."""
+    for quantity, (n, mean, m2, lo, hi) in totals.items():
+        if quantity == "skipped":
+            print(f"[WARN]: {n} windows left out, some rail had no reading in them")
+            continue
+        unit, scale = "ms" if quantity == "dur" else "mJ", 1e3
+        std = (m2 / (n - 1)) ** 0.5 if n > 1 else 0.0
+        print(f"[INFO]: {_wstat_name(quantity):>4} {mean * scale:.6f} ± {std * scale:.6f} {unit} per window "
+              f"(n={n}, min {lo * scale:.6f}, max {hi * scale:.6f})")
+
+
+def _hist_bin_bounds(b: int) -> tuple:
+    """Raw register range [lo, hi] of firmware histogram bin b (see src/PowerHist.h)."""
+    shift = max(0, (b >> HIST_SUB_BITS) - 1)
+    mantissa = b - (shift << HIST_SUB_BITS)
+    return mantissa << shift, ((mantissa + 1) << shift) - 1
+
+
+def hist_percentiles(bins: dict, quantiles=HIST_QUANTILES) -> list:
+    """Quantiles of a {bin: count} histogram, interpolated linearly inside a bin."""
+    total = sum(bins.values())
+    values = []
+    for q in quantiles:
+        target = q * total
+        cum = 0
+        for b in sorted(bins):
+            n = bins[b]
+            if cum + n >= target:
+                lo, hi = _hist_bin_bounds(b)
+                values.append(lo + (target - cum) / n * (hi - lo))
+                break
+            cum += n
+    return values
+
+
+def _hist_header() -> list:
+    return (["t_start", "t_end", "rail", "samples", "errors", "min"]
+            + [f"p{q * 100:g}" for q in HIST_QUANTILES] + ["max"])
+
+
+def _hist_row(line: str) -> list:
+    """Turn a '#HIST' line into a summary row, powers in watts."""
+    _, rail, t_start, t_end, lsb_uw, errors, packed = (line.split("\t") + [""])[:7]
+    bins = {int(b): int(n) for b, n in (item.split(":") for item in packed.split(",") if item)}
+    scale = int(lsb_uw) / 1e6
+    if not bins:
+        return [t_start, t_end, rail, 0, errors] + [""] * (len(HIST_QUANTILES) + 2)
+
+    lo, hi = _hist_bin_bounds(min(bins))[0], _hist_bin_bounds(max(bins))[1]
+    values = [lo] + hist_percentiles(bins) + [hi]
+    return [t_start, t_end, rail, sum(bins.values()), errors] + [f"{v * scale:.6f}" for v in values]
+
+
+def read_serial_and_log(port: str, csv_path: Path, ext_trigger: bool = False, step_hold: bool = False,
+                        commands: tuple = (), time_cols: int = 1, reconnect: bool = True, find_port=None,
+                        journal_path: Path = None, rails: int = 2, shunt_only: bool = False,
+                        trig_batch: bool = False) -> None:
+    """Log until Ctrl-C. On a lost link, reopen the port (re-detected with
+    `find_port` if given), resend `commands` and keep writing the same session;
+    the outage is recorded as a GAP event with its duration.
+
+    With `journal_path`, samples and trigger/event lines are appended to a
+    crash-consistent journal instead of the per-window CSV files, every
+    trigger window becoming an indexed segment with its energy over the first
+    `rails` power columns; recover, list and convert it with journal.py.
+
+    With `shunt_only`, the INA226 columns arrive as currents and are turned
+    into power with the interleaved #VBUS samples before being written.
+
+    With `trig_batch`, the windows arrive as batched #WIN bounds instead of
+    #START/#STOP and are cut out of the record stream into journal segments."""
     if verbose:
         print(f"[INFO]: Opening {port} @ {BAUD} (Ctrl-C to exit)")
     csv_path.parent.mkdir(parents=True, exist_ok=True)
@@ -97,79 +606,228 @@ def read_serial_and_log(port: str, csv_path: Path, ext_trigger: bool = False) ->
     header_written = False
     max_fields = 0
     spinner_idx = 0
-
-    with serial.Serial(port, BAUD, timeout=None) as ser:
-        time.sleep(UPLOAD_DELAY)
-        try:
-            while True:
-                if not verbose:
-                    sys.stdout.write(f"\r[INFO]: Running... {SPINNER[spinner_idx]}")
-                    sys.stdout.flush()
-                    spinner_idx = (spinner_idx + 1) % len(SPINNER)
-
-                line_bytes = ser.readline()
-                if not line_bytes:
-                    continue
-
-                line = line_bytes.decode(errors="replace").rstrip()
-                if not line:
-                    continue
-
-                # Handle trigger markers ------------------------------------------------
-                if line == "#START":
-                    timestamp = datetime.now().strftime("%Y-%m-%d_%H-%M-%S.%f")[:-3]
-                    current_path = csv_path.with_name(f"{base_stem}_{timestamp}{suffix}")
-                    current_f = current_path.open("w", newline="", encoding="utf-8")
-                    writer = csv.writer(current_f)
-                    header_written = False
-                    max_fields = 0
-                    if verbose:
-                        print(f"\n[INFO]: START logging -> {current_path}")
-                    continue
-
-                if line == "#STOP":
-                    if current_f:
-                        current_f.close()
-                        if verbose:
-                            print(f"\n[INFO]: STOP logging")
-                    current_f = None
-                    writer = None
-                    continue
-                # -----------------------------------------------------------------------
-
-                # Fallback: if no START received, open base file once
-                if not ext_trigger and writer is None:
-                    current_f = csv_path.open("a", newline="", encoding="utf-8")
-                    writer = csv.writer(current_f)
-                    header_written = current_f.tell() != 0
-                    max_fields = 0
-
-                if writer is None:
-                    if verbose:
-                        print("[ERROR]: No writer available, cannot log data.")
-                    continue
-
-                values = line.split("\t")
-                field_count = len(values)
-                if not header_written or field_count > max_fields:
-                    max_fields = max(max_fields, field_count)
-                    _write_header(writer, max_fields)
-                    header_written = True
-
-                padded = values + [""] * (max_fields - field_count)
-                writer.writerow(padded)
-                current_f.flush()
-
+    last_sent = {}
+    decoder = DeltaDecoder(1e-9 if shunt_only else 1e-6)
+    hist_log = SideLog(csv_path.with_name(f"{base_stem}_hist{suffix}"), _hist_header())
+    event_log = SideLog(csv_path.with_name(f"{base_stem}_events{suffix}"), ["event", "fields..."])
+    wstat_log = SideLog(csv_path.with_name(f"{base_stem}_wstat{suffix}"),
+                        ["quantity", "t", "count", "mean", "std", "min", "max", "m2"])
+    wstat_totals = {}
+    journal = None
+    if journal_path:
+        journal = JournalWriter(journal_path, time_cols, rails, 1e-9 if time_cols == 2 else 1e-6)
+    window_open = False
+    vbus = VbusRebuild(len(RAIL_NAMES), time_cols) if shunt_only else None
+    windows = WindowSplitter(time_cols) if trig_batch else None
+
+    def write_rows(rows: list) -> None:
+        nonlocal current_f, writer, header_written, max_fields
+        if not rows:
+            return
+        if journal:
+            if ext_trigger and not window_open:
+                return
+            for values in rows:
+                journal.add_row(values)
                 if verbose:
-                    print(f"{line}")
+                    print("\t".join(values))
+            return
 
-        except serial.SerialException as exc:
-            print(f"\n[ERROR]: Serial error: {exc}")
-        except KeyboardInterrupt:
-            print("\n[INFO]: Power logger stopped by user")
-        finally:
-            if current_f is not None:
-                current_f.close()
+        # Fallback: if no START received, open base file once
+        if not ext_trigger and writer is None:
+            current_f = csv_path.open("a", newline="", encoding="utf-8")
+            writer = csv.writer(current_f)
+            header_written = current_f.tell() != 0
+            max_fields = 0
+
+        if writer is None:
+            if verbose:
+                print("[ERROR]: No writer available, cannot log data.")
+            return
+
+        for values in rows:
+            field_count = len(values)
+            if not header_written or field_count > max_fields:
+                max_fields = max(max_fields, field_count)
+                _write_header(writer, max_fields)
+                header_written = True
+
+            padded = values + [""] * (max_fields - field_count)
+            writer.writerow(padded)
+            if verbose:
+                print("\t".join(values))
+        current_f.flush()
+
+    overflow_reported = 0
+
+    def release(rows: list, final: bool = False) -> None:
+        """Pass records on; with --trig-batch through the window splitter,
+        which `final` empties at a stream gap or on exit."""
+        nonlocal window_open, overflow_reported
+        if not windows:
+            write_rows(rows)
+            return
+        cut = windows.push(rows) + (windows.flush() if final else [])
+        if windows.overflow != overflow_reported:
+            print(f"\n[WARN]: {windows.overflow} records dropped waiting for their #WIN line so far")
+            overflow_reported = windows.overflow
+        timestamp = datetime.now().strftime("%Y-%m-%d_%H-%M-%S.%f")[:-3]
+        for _, _, window_rows in cut:
+            journal.add_line(f"#START\t{timestamp}")
+            window_open = True
+            write_rows(window_rows)
+            journal.add_line("#STOP")
+            window_open = False
+
+    ser = None
+    connected = False
+    gap_start = None
+    try:
+        while True:
+            try:
+                ser = serial.Serial(port, BAUD, timeout=READ_TIMEOUT_S)
+                time.sleep(UPLOAD_DELAY)
+                for cmd in commands:
+                    ser.write(f"{cmd}\n".encode())
+                connected = True
+                if gap_start is not None:
+                    # Blocks, held values, bus voltages and pending windows do
+                    # not carry over the outage
+                    release(vbus.flush() if vbus else [], final=True)
+                    if vbus:
+                        vbus.reset()
+                    gap_end = datetime.now()
+                    duration = (gap_end - gap_start).total_seconds()
+                    gap = [gap_start.isoformat(timespec="milliseconds"),
+                           gap_end.isoformat(timespec="milliseconds"), f"{duration:.3f}"]
+                    event_log.writerow(["GAP"] + gap)
+                    if journal:
+                        journal.add_line("\t".join(["#GAP"] + gap))
+                    print(f"\n[INFO]: Reconnected on {port} after {duration:.1f} s")
+                    gap_start = None
+                    decoder.reset()
+                    last_sent = {}
+
+                for line_bytes in _read_lines(ser, journal.poll if journal else None):
+                    if not verbose:
+                        sys.stdout.write(f"\r[INFO]: Running... {SPINNER[spinner_idx]}")
+                        sys.stdout.flush()
+                        spinner_idx = (spinner_idx + 1) % len(SPINNER)
+
+                    line = line_bytes.decode(errors="replace").rstrip()
+                    if not line:
+                        continue
+
+                    # Handle trigger markers ------------------------------------------------
+                    if line == "#START":
+                        timestamp = datetime.now().strftime("%Y-%m-%d_%H-%M-%S.%f")[:-3]
+                        last_sent = {}
+                        decoder.reset()
+                        if journal:
+                            journal.add_line(f"#START\t{timestamp}")
+                            window_open = True
+                            continue
+                        current_path = csv_path.with_name(f"{base_stem}_{timestamp}{suffix}")
+                        current_f = current_path.open("w", newline="", encoding="utf-8")
+                        writer = csv.writer(current_f)
+                        header_written = False
+                        max_fields = 0
+                        if verbose:
+                            print(f"\n[INFO]: START logging -> {current_path}")
+                        continue
+
+                    if line == "#STOP":
+                        if vbus:
+                            release(vbus.flush())
+                        if journal:
+                            journal.add_line(line)
+                            window_open = False
+                        if current_f:
+                            current_f.close()
+                            if verbose:
+                                print(f"\n[INFO]: STOP logging")
+                        current_f = None
+                        writer = None
+                        continue
+
+                    if line.startswith("#HIST\t"):
+                        hist_log.writerow(_hist_row(line))
+                        if journal:
+                            journal.add_line(line)
+                        continue
+
+                    if line.startswith("#WSTAT\t"):
+                        quantity, t, stat = _wstat(line)
+                        n, mean, m2, lo, hi = stat
+                        std = (m2 / (n - 1)) ** 0.5 if n > 1 else 0.0
+                        wstat_log.writerow([_wstat_name(quantity), t, n, mean, std, lo, hi, m2])
+                        wstat_totals[quantity] = merge_stat(wstat_totals.get(quantity), stat)
+                        if journal:
+                            journal.add_line(line)
+                        continue
+
+                    if line.startswith("#WIN\t") and windows:
+                        # Cut once their records are through, Vbus ones included
+                        windows.add(line)
+                        release([])
+                        continue
+
+                    if line.startswith("#BLK\t"):
+                        rows = decoder.decode(line[5:])
+                    elif line.startswith("#VBUS\t") and vbus:
+                        vbus.add(line)
+                        rows = []
+                    elif line.startswith("#"):
+                        _handle_event(line, event_log)
+                        if journal:
+                            journal.add_line(line)
+                        continue
+                    else:
+                        rows = [line.split("\t")]
+                    # -----------------------------------------------------------------------
+
+                    if step_hold:
+                        rows = [_step_hold(values, last_sent, time_cols) for values in rows]
+                    if vbus:
+                        rows = vbus.push(rows)
+                    release(rows)
+
+            except serial.SerialException as exc:
+                # A port that never opened is most likely wrong, only a
+                # re-detected one is worth waiting for
+                if not reconnect or (not connected and find_port is None):
+                    print(f"\n[ERROR]: Serial error: {exc}")
+                    break
+                if not connected:
+                    print(f"[WARN]: Cannot open {port} ({exc}), retrying...")
+                elif gap_start is None:
+                    gap_start = datetime.now()
+                    print(f"\n[WARN]: Serial link lost ({exc}), reconnecting...")
+                if ser is not None:
+                    ser.close()
+                    ser = None
+                time.sleep(RECONNECT_DELAY)
+                # The device may come back under another name
+                if find_port is not None:
+                    try:
+                        port = find_port()
+                    except RuntimeError:
+                        pass
+    except KeyboardInterrupt:
+        print("\n[INFO]: Power logger stopped by user")
+    finally:
+        if ser is not None:
+            ser.close()
+        release(vbus.flush() if vbus else [], final=True)
+        if current_f is not None:
+            current_f.close()
+        if journal:
+            journal.close()
+        hist_log.close()
+        event_log.close()
+        wstat_log.close()
+        if wstat_totals:
+            print_wstats(wstat_totals)
 
 
 def main(argv=None) -> None:
@@ -180,6 +838,59 @@ def main(argv=None) -> None:
     parser.add_argument("-p", "--port", help="Serial port (auto-detect if omitted)")
     parser.add_argument("-d", "--dst", default="./logs", help="CSV output dir (default: ./logs)")
     parser.add_argument("-t", "--ext-trigger", action="store_true", help="Start/stop sampling on external trigger")
+    parser.add_argument("--trig-min-us", type=int, help="With --ext-trigger, ignore trigger pulses shorter than this")
+    parser.add_argument("--trig-coalesce-us", type=int, help="With --ext-trigger, merge windows separated by less than this")
+    parser.add_argument("--trig-batch", type=int, metavar="N",
+                        help="With --ext-trigger, send window bounds N at a time (1-16) instead of per-window markers; implies --journal")
+    parser.add_argument("--window-stats", type=int, nargs="?", const=1000, metavar="MS",
+                        help="With --ext-trigger, send only running statistics of per-window energy and duration, every MS (default: 1000)")
+    parser.add_argument("--dual-bus", action="store_true", help="Read the PL rail on a second I2C bus (Wire1)")
+    parser.add_argument("--async-i2c", action="store_true", help="Non-blocking I2C transfers, overlapping bus reads with serial output")
+    parser.add_argument("--rtos", action="store_true", help="Sample from a realtime mbed OS thread at a fixed period")
+    parser.add_argument("--period-us", type=int, help="Sample period of --rtos in microseconds (default: 1000)")
+    parser.add_argument("--flush-us", type=int, help="Max time output waits for a full USB packet, in microseconds (default: 2000)")
+    parser.add_argument("--fixed-text", action="store_true", help="Format samples with integer fixed-point instead of the float printer")
+    parser.add_argument("--deadband", type=int, metavar="LSB", help="Send a rail only when it moves by more than LSB power LSBs")
+    parser.add_argument("--heartbeat-ms", type=int, default=1000, help="With --deadband, resend unchanged rails after this silence (default: 1000)")
+    parser.add_argument("--compress", action="store_true", help="Lossless delta/Rice compression of raw samples on the device")
+    parser.add_argument("--filter", choices=["ma", "iir", "fir"], help="On-device low-pass filter applied to every rail")
+    parser.add_argument("--taps", type=int, help="Moving average / FIR length (default: 16)")
+    parser.add_argument("--decimate", type=int, default=1, help="With --filter, send one filtered record every N samples (default: 1)")
+    parser.add_argument("--histogram", type=int, nargs="?", const=1000, metavar="MS",
+                        help="Send per-window power histograms instead of samples; windows are trigger windows with --ext-trigger, else MS long (default: 1000)")
+    parser.add_argument("--pwr-limit-ps", type=float, metavar="W", help="Hardware alert when PS power exceeds W (INA226 ALERT on D3)")
+    parser.add_argument("--pwr-limit-pl", type=float, metavar="W", help="Hardware alert when PL power exceeds W (INA226 ALERT on D4)")
+    parser.add_argument("--throttle-pin", type=int, help="Drive this pin HIGH while any rail is over its limit")
+    parser.add_argument("--auto-rails", action="store_true", help="Locate the rail monitors by scanning the mux channels and INA226 addresses")
+    parser.add_argument("--rescan", action="store_true", help="With --auto-rails, scan again instead of using the table stored in flash")
+    parser.add_argument("--pmbus", nargs="+", type=_pmbus_rail, metavar="ADDR[:PAGE]",
+                        help="Also log the output power of these PMBus regulator pages, as columns after PS/PL")
+    parser.add_argument("--pmbus-pec", action="store_true", help="Use packet error checking on PMBus transfers")
+    parser.add_argument("--adaptive", action="store_true", help="Sample fast while a rail is active, slow while all are steady; each record ends with its period in us")
+    parser.add_argument("--fast-us", type=int, default=250, help="With --adaptive, period while active (default: 250)")
+    parser.add_argument("--slow-us", type=int, default=10000, help="With --adaptive, period while steady (default: 10000)")
+    parser.add_argument("--activity-lsb", type=int, default=8, help="With --adaptive, step between records that counts as activity, in LSBs (default: 8)")
+    parser.add_argument("--activity-var", type=int, default=64, help="With --adaptive, running variance that counts as activity, in LSB^2 (default: 64)")
+    parser.add_argument("--hold-ms", type=int, default=100, help="With --adaptive, keep the fast rate this long after activity (default: 100)")
+    parser.add_argument("--time64", action="store_true", help="Stamp records with the start and end of their read in ns on a 64-bit device clock")
+    parser.add_argument("--profiles", action="store_true", help="Build with named configuration profiles stored in the device flash")
+    parser.add_argument("--profile", metavar="NAME", help="Switch the device to this profile before logging (implies --profiles)")
+    parser.add_argument("--list-profiles", action="store_true", help="List the profiles stored on the device and exit")
+    parser.add_argument("--save-profile", nargs="+", metavar=("NAME", "KEY=VALUE"),
+                        help="Create or update a profile on the device and exit; keys: avg, ct_us, period_us, trigger, limit_ps, limit_pl")
+    parser.add_argument("--delete-profile", metavar="NAME", help="Remove a profile from the device and exit")
+    parser.add_argument("--ext-clock", type=int, nargs="?", const=1, metavar="DIV",
+                        help="Sample on the rising edges of an external clock, DIV samples per clock period (default: 1, one per edge)")
+    parser.add_argument("--clock-pin", type=int, help="With --ext-clock, input pin of the clock (default: 5)")
+    parser.add_argument("--sync", action="store_true", help="Timestamp the pulses of a shared sync line, to align several loggers with align.py")
+    parser.add_argument("--sync-master", action="store_true", help="Drive the shared sync line from this logger (implies --sync)")
+    parser.add_argument("--sync-pin", type=int, help="With --sync, pin of the sync line (default: 6)")
+    parser.add_argument("--sync-period-ms", type=int, default=1000, help="With --sync-master, interval between pulses (default: 1000)")
+    parser.add_argument("--shunt-only", action="store_true",
+                        help="Read INA226 currents at the fastest rate and bus voltages every --vbus-ms; power is rebuilt on the host")
+    parser.add_argument("--vbus-ms", type=int, default=100, help="With --shunt-only, interval between bus voltage samples (default: 100)")
+    parser.add_argument("--journal", action="store_true", help="Write samples to a crash-consistent journal (.plj) instead of CSV; see journal.py")
+    parser.add_argument("--no-reconnect", action="store_true", help="End the session when the serial link drops instead of waiting for the device")
     parser.add_argument("-v", "--verbose", action="store_true", help="Verbose output")
     args = parser.parse_args(argv)
 
@@ -190,8 +901,38 @@ def main(argv=None) -> None:
     if not sketch_path.exists():
         sys.exit(f"[ERROR]: Sketch {sketch_path} not found.")
 
+    # Profile management talks to the firmware already on the device
+    if args.list_profiles or args.save_profile or args.delete_profile:
+        try:
+            port = args.port or autodetect_port()
+            commands = []
+            if args.save_profile:
+                commands.append("PSET " + " ".join(args.save_profile))
+            if args.delete_profile:
+                commands.append(f"PDEL {args.delete_profile}")
+            print_profiles(device_command(port, commands + ["PROFILES"]))
+        except Exception as exc:
+            sys.exit(f"[ERROR]: {exc}")
+        return
+
     try:
-        c_kwargs = dict(sketch = sketch_path, arduino_board = args.arduino_board, target_board = args.target_board, ext_trigger = args.ext_trigger)
+        c_kwargs = dict(sketch = sketch_path, arduino_board = args.arduino_board, target_board = args.target_board,
+                        ext_trigger = args.ext_trigger, trig_min_us = args.trig_min_us,
+                        trig_coalesce_us = args.trig_coalesce_us, trig_batch = args.trig_batch,
+                        window_stats = args.window_stats, dual_bus = args.dual_bus, async_i2c = args.async_i2c,
+                        rtos = args.rtos, period_us = args.period_us, flush_us = args.flush_us,
+                        fixed_text = args.fixed_text, deadband = args.deadband, heartbeat_ms = args.heartbeat_ms,
+                        compress = args.compress, filter = args.filter, taps = args.taps, decimate = args.decimate,
+                        histogram = args.histogram, pwr_limit_ps = args.pwr_limit_ps, pwr_limit_pl = args.pwr_limit_pl,
+                        throttle_pin = args.throttle_pin, auto_rails = args.auto_rails,
+                        pmbus = args.pmbus, pmbus_pec = args.pmbus_pec,
+                        profiles = args.profiles or args.profile is not None,
+                        adaptive = args.adaptive, fast_us = args.fast_us, slow_us = args.slow_us,
+                        activity_lsb = args.activity_lsb, activity_var = args.activity_var, hold_ms = args.hold_ms,
+                        time64 = args.time64, shunt_only = args.shunt_only, vbus_ms = args.vbus_ms,
+                        ext_clock = args.ext_clock, clock_pin = args.clock_pin,
+                        sync = args.sync, sync_master = args.sync_master, sync_pin = args.sync_pin,
+                        sync_period_ms = args.sync_period_ms)
         compile_sketch(**c_kwargs)
 
         port = args.port or autodetect_port()
@@ -203,7 +944,14 @@ def main(argv=None) -> None:
         log_dir.mkdir(parents=True, exist_ok=True)
 
         csv_path = log_dir / csv_name
-        read_serial_and_log(port, csv_path, ext_trigger=args.ext_trigger)
+        commands = ("SCAN",) if args.rescan else ()
+        commands += (f"PROFILE {args.profile}",) if args.profile else ()
+        read_serial_and_log(port, csv_path, ext_trigger=args.ext_trigger, step_hold=args.deadband is not None,
+                            commands=commands, time_cols=2 if args.time64 else 1,
+                            reconnect=not args.no_reconnect, find_port=None if args.port else autodetect_port,
+                            journal_path=csv_path.with_suffix(".plj") if args.journal or args.trig_batch else None,
+                            rails=len(RAIL_NAMES) + len(args.pmbus or ()), shunt_only=args.shunt_only,
+                            trig_batch=bool(args.trig_batch))
 
     except subprocess.CalledProcessError as exc:
         sys.exit(f"[ERROR]: Command failed with exit code {exc.returncode}")
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "AcqThread.h"
+
+#ifdef ACQ_THREAD_AVAILABLE
+
+#define ACQ_TICK_FLAG   0x1
+#define ACQ_STACK_SIZE  2048
+
+AcqThread::AcqThread(task_typeDef task, const uint32_t &period_us)
+    : _task(task),
+      _period_us(period_us),
+      _running(false),
+      _overruns(0),
+      _paused(false),
+      _busy(false),
+      _thread(osPriorityRealtime, ACQ_STACK_SIZE),
+      _ticks(0)
+{
+}
+
+void AcqThread::pause() {
+    // Both flags are sequentially consistent: either the task sees _paused
+    // before it starts, or we see it _busy and wait for it
+    _paused = true;
+    while (_busy) rtos::ThisThread::yield();
+}
+
+void AcqThread::set_period(const uint32_t &period_us) {
+    _period_us = period_us;
+    if (_running) _ticker.attach(mbed::callback(this, &AcqThread::_on_tick), std::chrono::microseconds(period_us));
+}
+
+void AcqThread::_serve() {
+    _busy = true;
+    if (!_paused) _task();
+    _busy = false;
+}
+
+void AcqThread::start() {
+    _running = true;
+    _thread.start(mbed::callback(this, &AcqThread::_run));
+    _ticker.attach(mbed::callback(this, &AcqThread::_on_tick), std::chrono::microseconds(_period_us.load()));
+}
+
+void AcqThread::stop() {
+    _ticker.detach();
+    _running = false;
+    _flags.set(ACQ_TICK_FLAG);
+    _thread.join();
+}
+
+void AcqThread::_on_tick() {
+    _ticks.fetch_add(1, std::memory_order_relaxed);
+    _flags.set(ACQ_TICK_FLAG);
+}
+
+void AcqThread::_run() {
+    uint32_t served = 0;
+    while (true) {
+        _flags.wait_any(ACQ_TICK_FLAG);
+        if (!_running) return;
+
+        // Ticks coalesced into one flag were missed periods
+        uint32_t ticks = _ticks.load(std::memory_order_relaxed);
+        if (ticks - served > 1) _overruns.fetch_add(ticks - served - 1, std::memory_order_relaxed);
+        served = ticks;
+
+        _serve();
+    }
+}
+
+#endif // ACQ_THREAD_AVAILABLE
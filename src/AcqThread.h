@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ACQ_THREAD_H
+#define ACQ_THREAD_H
+
+// Available on mbed OS cores only
+#if defined(ARDUINO_ARCH_MBED)
+#define ACQ_THREAD_AVAILABLE
+
+#include <stdint.h>
+#include <atomic>
+
+#include "mbed.h"
+
+// Runs a task at a fixed period in its own thread. The period is kept by a
+// Ticker (microsecond timer, not the 1 ms RTOS tick) that releases a
+// realtime-priority thread.
+class AcqThread {
+public:
+    typedef void (*task_typeDef)();
+
+    explicit AcqThread(task_typeDef task, const uint32_t &period_us);
+
+    void start();
+    void stop();
+    // Periods whose deadline passed before the task was released
+    uint32_t overruns() const { return _overruns.load(std::memory_order_relaxed); }
+    // Hold the task off, e.g. while the bus is reconfigured; pause() returns
+    // once a running task has finished. Periods keep being counted.
+    void pause();
+    void resume() { _paused = false; }
+    // Takes effect from the next period
+    void set_period(const uint32_t &period_us);
+
+private:
+    task_typeDef _task;
+    std::atomic<uint32_t> _period_us;
+    std::atomic<bool> _running;
+    std::atomic<uint32_t> _overruns;
+    std::atomic<bool> _paused;
+    std::atomic<bool> _busy;
+
+    rtos::Thread _thread;
+    rtos::EventFlags _flags;
+    mbed::Ticker _ticker;
+    std::atomic<uint32_t> _ticks;
+
+    void _run();
+    void _serve();
+    void _on_tick();
+};
+
+#endif // ARDUINO_ARCH_MBED
+#endif // ACQ_THREAD_H
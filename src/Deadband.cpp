@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Deadband.h"
+
+Deadband::Deadband(const uint16_t &lsb, const uint32_t &heartbeat_us)
+    : _lsb(lsb),
+      _heartbeat_us(heartbeat_us),
+      _primed(false),
+      _last(),
+      _last_t()
+{
+}
+
+bool Deadband::update(const uint32_t &t, const int32_t *raw, uint8_t &mask) {
+    mask = 0;
+    for (int i = 0; i < NUM_RAILS; i++) {
+        int32_t delta = raw[i] - _last[i];
+        if (!_primed || delta > _lsb || delta < -(int32_t)_lsb
+            || (uint32_t)(t - _last_t[i]) >= _heartbeat_us) {
+            _last[i] = raw[i];
+            _last_t[i] = t;
+            mask |= 1 << i;
+        }
+    }
+    _primed = true;
+    return mask != 0;
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include "INA226.h"
+
+// Change-driven emission: a rail is sent only when it moved by more than
+// `lsb` power LSBs since it was last sent, or as a heartbeat after
+// `heartbeat_us` of silence. The host holds the last value in between.
+class Deadband {
+public:
+    explicit Deadband(const uint16_t &lsb, const uint32_t &heartbeat_us);
+
+    // Set bit i of `mask` for each rail to send, false if none is due
+    bool update(const uint32_t &t, const int32_t *raw, uint8_t &mask);
+    // Send every rail on the next update, e.g. at the start of a window
+    void reset() { _primed = false; }
+
+private:
+    uint16_t _lsb;
+    uint32_t _heartbeat_us;
+    bool _primed;
+    int32_t _last[NUM_RAILS];
+    uint32_t _last_t[NUM_RAILS];
+};
+
+#endif // DEADBAND_H
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "DeltaCoder.h"
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static inline uint32_t zigzag(const int32_t &val) {
+    return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+}
+
+DeltaCoder::DeltaCoder(const uint32_t *lsb_uw)
+    : _lsb_uw(lsb_uw),
+      _t(0),
+      _dt(0),
+      _raw(),
+      _seq(0),
+      _until_key(0),
+      _key(false),
+      _key_t(0),
+      _key_raw(),
+      _n(0),
+      _bits(0)
+{
+}
+
+void DeltaCoder::push(const uint32_t &t, const int32_t *raw, Print *out) {
+    if (_n == 0) {
+        _key = (_until_key == 0);
+        if (_key) {
+            // The keyframe state is the first record, whose deltas are zero
+            _key_t = _t = t;
+            _dt = 0;
+            for (int i = 0; i < NUM_RAILS; i++) _key_raw[i] = _raw[i] = raw[i];
+        }
+    }
+
+    uint32_t dt = t - _t;
+    _zz[0][_n] = zigzag((int32_t)(dt - _dt));
+    _dt = dt;
+    _t = t;
+    for (int i = 0; i < NUM_RAILS; i++) {
+        _zz[i + 1][_n] = zigzag(raw[i] - _raw[i]);
+        _raw[i] = raw[i];
+    }
+
+    if (++_n == DELTA_BLOCK_LEN) flush(out);
+}
+
+void DeltaCoder::flush(Print *out) {
+    if (_n == 0) return;
+
+    _bits = 0;
+    _put_bits(_seq, 8);
+    _put_bits(_key ? 1 : 0, 8);
+    _put_bits(NUM_RAILS, 8);
+    _put_bits(_n, 8);
+    if (_key) {
+        _put_varint(_key_t);
+        for (int i = 0; i < NUM_RAILS; i++) _put_varint(zigzag(_key_raw[i]));
+        for (int i = 0; i < NUM_RAILS; i++) _put_varint(_lsb_uw[i]);
+    }
+
+    // Rice parameter ~ log2 of the mean magnitude of each stream
+    uint8_t k[DELTA_STREAMS];
+    for (int s = 0; s < DELTA_STREAMS; s++) {
+        uint64_t sum = 0;
+        for (uint8_t j = 0; j < _n; j++) sum += _zz[s][j];
+        uint32_t mean = (uint32_t)(sum / _n);
+        k[s] = 0;
+        while (k[s] < 31 && (2UL << k[s]) <= mean) k[s]++;
+        _put_bits(k[s], 8);
+    }
+
+    for (uint8_t j = 0; j < _n; j++) {
+        for (int s = 0; s < DELTA_STREAMS; s++) _put_rice(_zz[s][j], k[s]);
+    }
+
+    _send(out);
+
+    _seq++;
+    _until_key = _key ? DELTA_KEY_EVERY - 1 : _until_key - 1;
+    _n = 0;
+}
+
+void DeltaCoder::_put_bits(const uint32_t &val, const uint8_t &len) {
+    for (int8_t b = len - 1; b >= 0; b--) {
+        uint8_t mask = 0x80 >> (_bits & 7);
+        if ((val >> b) & 1) _buf[_bits >> 3] |= mask;
+        else _buf[_bits >> 3] &= ~mask;
+        _bits++;
+    }
+}
+
+void DeltaCoder::_put_varint(uint32_t val) {
+    while (val >= 0x80) {
+        _put_bits((val & 0x7f) | 0x80, 8);
+        val >>= 7;
+    }
+    _put_bits(val, 8);
+}
+
+void DeltaCoder::_put_rice(const uint32_t &val, const uint8_t &k) {
+    uint32_t q = val >> k;
+    if (q >= RICE_ESCAPE) {
+        for (uint8_t i = 0; i < RICE_ESCAPE; i++) _put_bits(1, 1);
+        _put_bits(val, 32);
+        return;
+    }
+    for (uint32_t i = 0; i < q; i++) _put_bits(1, 1);
+    _put_bits(0, 1);
+    if (k) _put_bits(val, k);
+}
+
+void DeltaCoder::_send(Print *out) {
+    uint16_t len = (_bits + 7) >> 3;
+    // Zero the padding bits of the last byte
+    if (_bits & 7) _buf[len - 1] &= 0xff << (8 - (_bits & 7));
+
+    out->print(F("#BLK\t"));
+    char quad[4];
+    for (uint16_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)_buf[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)_buf[i + 1] << 8;
+        if (i + 2 < len) v |= _buf[i + 2];
+        quad[0] = b64[(v >> 18) & 0x3f];
+        quad[1] = b64[(v >> 12) & 0x3f];
+        quad[2] = (i + 1 < len) ? b64[(v >> 6) & 0x3f] : '=';
+        quad[3] = (i + 2 < len) ? b64[v & 0x3f] : '=';
+        out->write((const uint8_t *)quad, 4);
+    }
+    out->println();
+}
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DELTA_CODER_H
+#define DELTA_CODER_H
+
+#include "INA226.h"
+
+// Records per block
+#ifndef DELTA_BLOCK_LEN
+  #define DELTA_BLOCK_LEN 32
+#endif
+// Blocks between keyframes
+#ifndef DELTA_KEY_EVERY
+  #define DELTA_KEY_EVERY 16
+#endif
+// Timestamp plus one stream per rail
+#define DELTA_STREAMS (NUM_RAILS + 1)
+// Quotients this long are sent as a verbatim 32-bit value instead
+#define RICE_ESCAPE 24
+// Worst-case header: 4 bytes, a keyframe of one 5-byte varint per stream
+// (time and rails) plus one per rail LSB, and a Rice parameter per stream
+#define DELTA_HDR_LEN (4 + 5 * (2 * DELTA_STREAMS - 1) + DELTA_STREAMS)
+#define DELTA_BUF_LEN (DELTA_HDR_LEN + DELTA_STREAMS * DELTA_BLOCK_LEN * (RICE_ESCAPE + 32) / 8)
+
+// Lossless block coder for raw records. Timestamps are coded as the change
+// of the sample interval, rails as the change of the power register; both
+// are zigzagged and Rice-coded with a parameter chosen per block and stream.
+// Blocks go out as "#BLK\t<base64>" lines, so they coexist with markers and
+// events. Block layout (bit stream MSB first):
+//
+//   u8 seq, u8 flags (bit 0 = keyframe), u8 rails, u8 records
+//   keyframe only: varint t, varint zigzag(raw) × rails, varint lsb_uw × rails (nW/nA with SHUNT_ONLY)
+//   u8 k × streams
+//   per record, per stream: Rice(zigzag(delta), k)
+//
+// A keyframe restarts the deltas from its own state, so a decoder that lost
+// a block (seq gap) resynchronises on the next keyframe.
+class DeltaCoder {
+public:
+    explicit DeltaCoder(const uint32_t *lsb_uw);
+
+    // Buffer a record, writing the block once it is full
+    void push(const uint32_t &t, const int32_t *raw, Print *out);
+    // Write the partial block, if any
+    void flush(Print *out);
+    // Make the next block a keyframe, e.g. at the start of a window
+    void force_key() { _until_key = 0; }
+
+private:
+    const uint32_t * _lsb_uw;
+
+    // Running state the deltas are taken against
+    uint32_t _t;
+    uint32_t _dt;
+    int32_t _raw[NUM_RAILS];
+
+    // Current block
+    uint8_t _seq;
+    uint8_t _until_key;
+    bool _key;
+    uint32_t _key_t;
+    int32_t _key_raw[NUM_RAILS];
+    uint8_t _n;
+    uint32_t _zz[DELTA_STREAMS][DELTA_BLOCK_LEN];
+
+    uint8_t _buf[DELTA_BUF_LEN];
+    uint16_t _bits;
+
+    void _put_bits(const uint32_t &val, const uint8_t &len);
+    void _put_varint(uint32_t val);
+    void _put_rice(const uint32_t &val, const uint8_t &k);
+    void _send(Print *out);
+};
+
+#endif // DELTA_CODER_H
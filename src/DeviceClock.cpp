@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "DeviceClock.h"
+
+#ifdef DEVICE_CLOCK_HW_TIMER
+  #define CLOCK_TIMER NRF_TIMER4
+  #define CLOCK_HZ 16000000UL
+  // Well inside the 2^32 / 16 MHz = 268 s wrap
+  #define CLOCK_KEEP_S 60
+#else
+  #define CLOCK_HZ 1000000UL
+#endif
+
+DeviceClock::DeviceClock() : _last(0), _wraps(0) {}
+
+#ifdef DEVICE_CLOCK_HW_TIMER
+void DeviceClock::begin() {
+    CLOCK_TIMER->TASKS_STOP = 1;
+    CLOCK_TIMER->MODE = TIMER_MODE_MODE_Timer;
+    CLOCK_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    CLOCK_TIMER->PRESCALER = 0;
+    CLOCK_TIMER->TASKS_CLEAR = 1;
+    CLOCK_TIMER->TASKS_START = 1;
+    _keeper.attach(mbed::callback(this, &DeviceClock::_keep), std::chrono::seconds(CLOCK_KEEP_S));
+}
+
+uint64_t DeviceClock::now_ticks() {
+    // The acquisition thread, loop() and the keeper all read the clock
+    core_util_critical_section_enter();
+    CLOCK_TIMER->TASKS_CAPTURE[0] = 1;
+    uint32_t lo = CLOCK_TIMER->CC[0];
+    if (lo < _last) _wraps++;
+    _last = lo;
+    uint64_t ticks = ((uint64_t)_wraps << 32) | lo;
+    core_util_critical_section_exit();
+    return ticks;
+}
+#else
+void DeviceClock::begin() {}
+
+uint64_t DeviceClock::now_ticks() {
+    noInterrupts();
+    uint32_t lo = micros();
+    if (lo < _last) _wraps++;
+    _last = lo;
+    uint64_t ticks = ((uint64_t)_wraps << 32) | lo;
+    interrupts();
+    return ticks;
+}
+#endif
+
+uint64_t DeviceClock::now_ns() {
+    uint64_t ticks = now_ticks();
+    return (ticks / CLOCK_HZ) * 1000000000ULL + (ticks % CLOCK_HZ) * 1000000000ULL / CLOCK_HZ;
+}
+
+uint32_t DeviceClock::tick_hz() const { return CLOCK_HZ; }
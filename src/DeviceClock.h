@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef DEVICE_CLOCK_H
+#define DEVICE_CLOCK_H
+
+#include "Arduino.h"
+
+// nRF52840: TIMER4 free-running at 16 MHz (62.5 ns), a peripheral mbed OS
+// leaves alone, and which keeps counting while the CPU sleeps
+#if defined(ARDUINO_ARCH_MBED) && defined(NRF52840_XXAA)
+  #define DEVICE_CLOCK_HW_TIMER
+  #include "mbed.h"
+  #include "nrf.h"
+#endif
+
+// Monotonic 64-bit device time base. The 32-bit hardware counter is
+// extended in software on every read; a ticker reads it well within each
+// wrap (268 s) so idle periods cannot skip one. Other targets extend
+// micros(), which then has to be read at least every 71 minutes.
+class DeviceClock {
+public:
+    DeviceClock();
+
+    void begin();
+    uint64_t now_ticks();
+    uint64_t now_ns();
+    uint32_t tick_hz() const;
+
+private:
+    uint32_t _last;
+    uint32_t _wraps;
+
+#ifdef DEVICE_CLOCK_HW_TIMER
+    mbed::Ticker _keeper;
+
+    void _keep() { now_ticks(); }
+#endif
+};
+
+#endif // DEVICE_CLOCK_H
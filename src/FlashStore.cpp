@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "FlashStore.h"
+
+#include <string.h>
+
+typedef struct flash_hdr {
+    uint32_t magic;
+    uint16_t len;
+    uint16_t sum;
+} flash_hdr_typeDef;
+
+// Fletcher-16 over the payload
+static uint16_t checksum(const uint8_t *p, const uint16_t &len) {
+    uint16_t a = 0, b = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        a = (a + p[i]) % 255;
+        b = (b + a) % 255;
+    }
+    return (b << 8) | a;
+}
+
+FlashStore::FlashStore(const uint8_t &slot) : _slot(slot) {}
+
+#ifdef FLASH_STORE_AVAILABLE
+uint32_t FlashStore::_sector_addr() {
+    uint32_t addr = _flash.get_flash_start() + _flash.get_flash_size();
+    for (uint8_t i = 0; i <= _slot; i++) addr -= _flash.get_sector_size(addr - 1);
+    return addr;
+}
+
+bool FlashStore::load(void *buf, const uint16_t &len, const uint32_t &magic) {
+    if (len > FLASH_STORE_MAX || _flash.init() != 0) return false;
+
+    flash_hdr_typeDef hdr;
+    uint32_t addr = _sector_addr();
+    bool ok = _flash.read(&hdr, addr, sizeof(hdr)) == 0 && hdr.magic == magic && hdr.len == len &&
+              _flash.read(buf, addr + sizeof(hdr), len) == 0 && checksum((const uint8_t *)buf, len) == hdr.sum;
+    _flash.deinit();
+    return ok;
+}
+
+bool FlashStore::save(const void *buf, const uint16_t &len, const uint32_t &magic) {
+    // Programming goes in whole pages, so the record is staged padded
+    static uint8_t page[sizeof(flash_hdr_typeDef) + FLASH_STORE_MAX + 16];
+    if (len > FLASH_STORE_MAX || _flash.init() != 0) return false;
+
+    flash_hdr_typeDef hdr = {magic, len, checksum((const uint8_t *)buf, len)};
+    uint32_t addr = _sector_addr();
+    uint32_t page_size = _flash.get_page_size();
+    uint32_t size = (sizeof(hdr) + len + page_size - 1) / page_size * page_size;
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &hdr, sizeof(hdr));
+    memcpy(page + sizeof(hdr), buf, len);
+
+    bool ok = size <= sizeof(page) &&
+              _flash.erase(addr, _flash.get_sector_size(addr)) == 0 &&
+              _flash.program(page, addr, size) == 0;
+    _flash.deinit();
+    return ok;
+}
+
+bool FlashStore::erase() {
+    if (_flash.init() != 0) return false;
+    uint32_t addr = _sector_addr();
+    bool ok = _flash.erase(addr, _flash.get_sector_size(addr)) == 0;
+    _flash.deinit();
+    return ok;
+}
+#else
+bool FlashStore::load(void *, const uint16_t &, const uint32_t &) { return false; }
+bool FlashStore::save(const void *, const uint16_t &, const uint32_t &) { return false; }
+bool FlashStore::erase() { return false; }
+#endif
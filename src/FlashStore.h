@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <stdint.h>
+
+#if defined(ARDUINO_ARCH_MBED) && defined(DEVICE_FLASH)
+  #define FLASH_STORE_AVAILABLE
+  #include "mbed.h"
+#endif
+
+// Largest record a slot holds
+#define FLASH_STORE_MAX 512
+
+// A small record kept in one sector of the internal flash, counted back from
+// the end of the device so it stays clear of the sketch. Each record carries
+// a magic word, its length and a checksum: a layout change (new magic), an
+// erased sector or an interrupted write all read back as "nothing stored".
+// Without on-chip flash access load() always fails and save() is a no-op.
+class FlashStore {
+public:
+    explicit FlashStore(const uint8_t &slot);
+
+    bool load(void *buf, const uint16_t &len, const uint32_t &magic);
+    bool save(const void *buf, const uint16_t &len, const uint32_t &magic);
+    bool erase();
+
+private:
+    uint8_t _slot;
+
+#ifdef FLASH_STORE_AVAILABLE
+    mbed::FlashIAP _flash;
+
+    uint32_t _sector_addr();
+#endif
+};
+
+#endif // FLASH_STORE_H
@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "I2CAsync.h"
+
+I2CAsync::I2CAsync(TwoWire *wire)
+    : _wire(wire),
+      _head(0),
+      _tail(0)
+#ifdef I2C_ASYNC_MBED
+    , _i2c(nullptr),
+      _running(false),
+      _done(false),
+      _event(0)
+#endif
+{
+#ifdef I2C_ASYNC_MBED
+    // Same pins as the matching Wire instance, mbed::I2C arbitrates between
+    // objects sharing a peripheral
+#if WIRE_HOWMANY > 1
+    if (wire == &Wire1) _i2c = new mbed::I2C(I2C_SDA1, I2C_SCL1);
+    else
+#endif
+    _i2c = new mbed::I2C(I2C_SDA, I2C_SCL);
+    _i2c->frequency(400000);
+#endif
+}
+
+bool I2CAsync::submit(i2c_xfer_typeDef *xfer) {
+    uint8_t next = (_tail + 1) % I2C_QUEUE_LEN;
+    if (next == _head) return false;
+
+    xfer->status = I2C_XFER_PENDING;
+    _queue[_tail] = xfer;
+    _tail = next;
+
+#ifdef I2C_ASYNC_MBED
+    if (!_running) _start();
+#endif
+    return true;
+}
+
+void I2CAsync::poll() {
+#ifdef I2C_ASYNC_MBED
+    if (!_running || !_done) return;
+
+    _running = false;
+    _complete((_event == I2C_EVENT_TRANSFER_COMPLETE) ? I2C_XFER_OK : I2C_XFER_ERROR);
+    if (!idle()) _start();
+#else
+    // Portable fallback: drain the queue on the spot
+    while (!idle()) _complete(_run_blocking(_queue[_head]));
+#endif
+}
+
+void I2CAsync::_complete(const int8_t &status) {
+    i2c_xfer_typeDef *xfer = _queue[_head];
+    _head = (_head + 1) % I2C_QUEUE_LEN;
+
+    xfer->status = status;
+    if (xfer->cb) xfer->cb(xfer, xfer->ctx);
+}
+
+#ifdef I2C_ASYNC_MBED
+void I2CAsync::_start() {
+    i2c_xfer_typeDef *xfer = _queue[_head];
+
+    _done = false;
+    _running = true;
+    // mbed wants the 8-bit address; the TWIM moves both phases via EasyDMA
+    if (_i2c->transfer(xfer->addr << 1,
+                       (const char *)xfer->tx, xfer->tx_len,
+                       (char *)xfer->rx, xfer->rx_len,
+                       mbed::callback(this, &I2CAsync::_on_event),
+                       I2C_EVENT_ALL, false) != 0) {
+        _event = I2C_EVENT_ERROR;
+        _done = true;
+    }
+}
+
+void I2CAsync::_on_event(int event) {
+    _event = event;
+    _done = true;
+}
+#else
+const int8_t I2CAsync::_run_blocking(i2c_xfer_typeDef *xfer) {
+    _wire->beginTransmission(xfer->addr);
+    _wire->write(xfer->tx, xfer->tx_len);
+    if (_wire->endTransmission(xfer->rx_len == 0) != 0) return I2C_XFER_ERROR;
+    if (xfer->rx_len == 0) return I2C_XFER_OK;
+
+    if (_wire->requestFrom(xfer->addr, xfer->rx_len) != xfer->rx_len) return I2C_XFER_ERROR;
+    for (uint8_t i = 0; i < xfer->rx_len; i++) xfer->rx[i] = _wire->read();
+    return I2C_XFER_OK;
+}
+#endif
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+// mbed targets with asynchronous I2C (nRF52840 TWIM runs on EasyDMA) get the
+// non-blocking backend, everything else runs the queue on top of Wire
+#if defined(ASYNC_I2C) && defined(ARDUINO_ARCH_MBED) && defined(DEVICE_I2C_ASYNCH)
+  #define I2C_ASYNC_MBED
+  #include "mbed.h"
+#endif
+
+// Depth of the transfer queue of each bus
+#define I2C_QUEUE_LEN 8
+
+// Transfer status
+#define I2C_XFER_OK       0
+#define I2C_XFER_PENDING  1
+#define I2C_XFER_ERROR   -1
+
+struct i2c_xfer;
+typedef void (*i2c_cb_typeDef)(struct i2c_xfer *xfer, void *ctx);
+
+// Transfer descriptor: write phase (register pointer, payload) followed by an
+// optional read phase with repeated start. Owned by the caller, it must stay
+// alive until its status leaves I2C_XFER_PENDING.
+typedef struct i2c_xfer {
+    uint8_t addr;
+    uint8_t tx[3];
+    uint8_t tx_len;
+    uint8_t rx[2];
+    uint8_t rx_len;
+    volatile int8_t status;
+    i2c_cb_typeDef cb;
+    void *ctx;
+} i2c_xfer_typeDef;
+
+class I2CAsync {
+public:
+    explicit I2CAsync(TwoWire *wire = &Wire);
+
+    // Queue a transfer, false if the queue is full
+    bool submit(i2c_xfer_typeDef *xfer);
+    // Advance the queue; completion callbacks always run from here, never
+    // from interrupt context, so they may submit follow-up transfers
+    void poll();
+    bool idle() const { return _head == _tail; }
+
+private:
+    TwoWire * _wire;
+    i2c_xfer_typeDef * _queue[I2C_QUEUE_LEN];
+    uint8_t _head;
+    uint8_t _tail;
+
+    void _complete(const int8_t &status);
+
+#ifdef I2C_ASYNC_MBED
+    mbed::I2C * _i2c;
+    bool _running;
+    volatile bool _done;
+    volatile int _event;
+
+    void _start();
+    void _on_event(int event);
+#else
+    const int8_t _run_blocking(i2c_xfer_typeDef *xfer);
+#endif
+};
+
+#endif // I2C_ASYNC_H
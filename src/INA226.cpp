@@ -19,54 +19,232 @@
 INA226::INA226(const board_typeDef &board, TwoWire *wire)
     : _address(STD_ADDR),
       _board(board),
-      _wire(wire)
+      _wire(wire),
+      _cur_sensor(NUM_SENS),
+      _shunt_only(false),
+      _bus(wire),
+      _mux_xfer(),
+      _pwr_xfer()
 {
+    for (int i = 0; i < NUM_SENS; i++) _rail[i] = {(uint8_t)i, _address};
     _wire->begin();
     set_I2C_speed(400000UL);
-    for (int i = 0; i < NUM_SENS; i++) { 
-        _sel_sensor((sensor_typeDef)i);
-        _write_reg(CAL_REG, cal_reg[_board][i]); 
-    }
+    calibrate();
 }
 
 INA226::INA226(const uint8_t &addr, const board_typeDef &board, TwoWire *wire)
     : _address(addr),
       _board(board),
-      _wire(wire)
+      _wire(wire),
+      _cur_sensor(NUM_SENS),
+      _shunt_only(false),
+      _bus(wire),
+      _mux_xfer(),
+      _pwr_xfer()
 {
+    for (int i = 0; i < NUM_SENS; i++) _rail[i] = {(uint8_t)i, _address};
     _wire->begin();
     set_I2C_speed(400000UL);
+    calibrate();
+}
+
+const void INA226::set_I2C_speed(const uint16_t &speed) {
+    _wire->setClock((speed == 400000UL) ? 400000UL : 100000UL);
+}
+
+const void INA226::set_addr(const uint8_t &addr) {
+    _address = addr;
+    for (int i = 0; i < NUM_SENS; i++) _rail[i].addr = addr;
+}
+
+const void INA226::calibrate() {
     for (int i = 0; i < NUM_SENS; i++) { 
         _sel_sensor((sensor_typeDef)i);
         _write_reg(CAL_REG, cal_reg[_board][i]); 
     }
 }
 
-const void INA226::set_I2C_speed(const uint16_t &speed) {
-    _wire->setClock((speed == 400000UL) ? 400000UL : 100000UL);
+const void INA226::set_config(const uint16_t &config) {
+    for (int i = 0; i < NUM_SENS; i++) { 
+        _sel_sensor((sensor_typeDef)i);
+        _write_reg(CONFIG_REG, config); 
+    }
+}
+
+const void INA226::set_rail(const sensor_typeDef &sensor, const rail_loc_typeDef &loc) {
+    _rail[sensor] = loc;
+    _cur_sensor = NUM_SENS;
 }
 
-const void INA226::set_addr(const uint8_t &addr) { _address = addr; }
+const uint8_t INA226::scan(rail_loc_typeDef *found, const uint8_t &max) {
+    uint8_t n = 0;
+    uint8_t saved = _address;
+
+    for (uint8_t ch = 0; ch < _mux_channels() && n < max; ch++) {
+        _wire->beginTransmission(MUX_ADDR);
+        _wire->write(_mux_code(ch));
+        if (_wire->endTransmission() != 0) break;
+
+        for (uint8_t addr = INA226_ADDR_FIRST; addr <= INA226_ADDR_LAST && n < max; addr++) {
+            _address = addr;
+            // The first monitor on a channel is its rail
+            if (_read_reg(MFG_ID_REG) == INA226_MFG_ID && _read_reg(DIE_ID_REG) == INA226_DIE_ID) {
+                found[n++] = {ch, addr};
+                break;
+            }
+        }
+    }
+
+    _address = saved;
+    _cur_sensor = NUM_SENS;
+    return n;
+}
 
 const float INA226::get_pwr(const sensor_typeDef &sensor) {
-    _sel_sensor(sensor);
-    float pwr = (float)_read_reg(PWR_REG) * (lsb_val[_board][sensor] * 25);
+    float pwr = (float)get_pwr_raw(sensor) * (lsb_val[_board][sensor] * 25);
     return pwr;
 }
 
-void INA226::_sel_sensor(const sensor_typeDef &sensor) {
-    _wire->beginTransmission(MUX_ADDR);
+const int32_t INA226::get_pwr_raw(const sensor_typeDef &sensor) {
+    _sel_sensor(sensor);
+    return _read_reg(PWR_REG);
+}
+
+const uint32_t INA226::pwr_lsb_uw(const sensor_typeDef &sensor) {
+    return (uint32_t)lroundf(lsb_val[_board][sensor] * 25 * 1e6f);
+}
+
+const int8_t INA226::set_pwr_limit(const sensor_typeDef &sensor, const float &watts) {
+    // The Alert Limit register is compared against the Power register, so
+    // it takes the same LSB
+    float lsb = lsb_val[_board][sensor] * 25;
+    uint16_t limit = (uint16_t)constrain(lroundf(watts / lsb), 0L, 0xffffL);
+
+    _sel_sensor(sensor);
+    int8_t ret = _write_reg(ALERT_REG, limit);
+    if (ret == 0) ret = _write_reg(MASK_REG, (watts > 0) ? MASK_POL : 0);
+    return ret;
+}
+
+const void INA226::set_shunt_only(const bool &on) {
+    _shunt_only = on;
+    set_config(on ? CONFIG_SHUNT_CONT : CONFIG_RESET);
+}
+
+const int32_t INA226::get_cur_raw(const sensor_typeDef &sensor) {
+    _sel_sensor(sensor);
+    int32_t val = _read_reg(CUR_REG);
+    if (val < 0) return -1;
+    return ((int16_t)val < 0) ? 0 : val;
+}
+
+const uint32_t INA226::cur_lsb_na(const sensor_typeDef &sensor) {
+    return (uint32_t)lroundf(lsb_val[_board][sensor] * 1e9f);
+}
+
+const int32_t INA226::get_bus_raw(const sensor_typeDef &sensor) {
+    _sel_sensor(sensor);
+    if (_write_reg(CONFIG_REG, CONFIG_BUS_TRIG) != 0) return -1;
+
+    // Reading Mask/Enable clears the flag, it is set once the bus is converted
+    int32_t val = -1;
+    uint32_t start = micros();
+    while (micros() - start < BUS_CONV_TIMEOUT_US) {
+        int32_t mask = _read_reg(MASK_REG);
+        if (mask >= 0 && (mask & MASK_CVRF)) {
+            val = _read_reg(BUS_REG);
+            break;
+        }
+    }
+
+    _write_reg(CONFIG_REG, CONFIG_SHUNT_CONT);
+    return val;
+}
+
+const bool INA226::request_pwr(const sensor_typeDef &sensor) {
+    i2c_xfer_typeDef *pwr = &_pwr_xfer[sensor];
+    // A request that cannot be queued reads as failed, not as the last value
+    pwr->status = I2C_XFER_ERROR;
+
+    if (sensor != _cur_sensor) {
+        i2c_xfer_typeDef *mux = &_mux_xfer[sensor];
+        mux->addr = MUX_ADDR;
+        mux->tx[0] = _mux_code(_rail[sensor].mux);
+        mux->tx_len = 1;
+        mux->rx_len = 0;
+        mux->cb = _on_mux_done;
+        mux->ctx = this;
+        if (!_bus.submit(mux)) return false;
+        _cur_sensor = sensor;
+    }
+
+    pwr->addr = _rail[sensor].addr;
+    pwr->tx[0] = _shunt_only ? CUR_REG : PWR_REG;
+    pwr->tx_len = 1;
+    pwr->rx_len = 2;
+    pwr->cb = nullptr;
+    pwr->ctx = nullptr;
+    return _bus.submit(pwr);
+}
+
+const bool INA226::pwr_ready(const sensor_typeDef &sensor) {
+    _bus.poll();
+    return _pwr_xfer[sensor].status != I2C_XFER_PENDING;
+}
+
+const float INA226::take_pwr(const sensor_typeDef &sensor) {
+    return (float)take_pwr_raw(sensor) * (lsb_val[_board][sensor] * 25);
+}
+
+const int32_t INA226::take_pwr_raw(const sensor_typeDef &sensor) {
+    const i2c_xfer_typeDef *pwr = &_pwr_xfer[sensor];
+    if (pwr->status != I2C_XFER_OK) return -1;
+    int32_t val = (pwr->rx[0] << 8) | pwr->rx[1];
+    return (_shunt_only && (int16_t)val < 0) ? 0 : val;
+}
+
+void INA226::_on_mux_done(i2c_xfer_typeDef *xfer, void *ctx) {
+    // Force a new mux write on the next request if the switch failed
+    if (xfer->status != I2C_XFER_OK) static_cast<INA226 *>(ctx)->_cur_sensor = NUM_SENS;
+}
+
+const uint8_t INA226::_mux_channels() {
+#ifdef BOARD_ZCU106
+    return 4;
+#else
+    return 8;
+#endif
+}
+
+const uint8_t INA226::_mux_code(const uint8_t &channel) {
 #ifdef BOARD_ZCU106
     // ZCU106: PS→canale 2 (0x04), PL→canale 3 (0x05)
-    _wire->write(static_cast<uint8_t>(sensor) + 0x04);
+    return channel + 0x04;
 #elif defined(BOARD_ZCU102)
     // ZCU102: PS→bus 0 (0x01), PL→bus 1 (0x02)
-    _wire->write(static_cast<uint8_t>(1 << static_cast<uint8_t>(sensor)));
+    return static_cast<uint8_t>(1 << channel);
 #else
     // fallback generico: abilita sempre il bus corrispondente
-    _wire->write(static_cast<uint8_t>(1 << static_cast<uint8_t>(sensor)));
+    return static_cast<uint8_t>(1 << channel);
 #endif
-    _wire->endTransmission();
+}
+
+const int8_t INA226::route_mux(const uint8_t &channel) {
+    _cur_sensor = NUM_SENS;
+    _wire->beginTransmission(MUX_ADDR);
+    _wire->write(_mux_code(channel));
+    return _wire->endTransmission();
+}
+
+void INA226::_sel_sensor(const sensor_typeDef &sensor) {
+    // Skip the mux write when the channel is already routed, e.g. when
+    // each bus only carries a single rail
+    _address = _rail[sensor].addr;
+    if (sensor == _cur_sensor) return;
+
+    _wire->beginTransmission(MUX_ADDR);
+    _wire->write(_mux_code(_rail[sensor].mux));
+    _cur_sensor = (_wire->endTransmission() == 0) ? sensor : NUM_SENS;
 }
 
 
@@ -19,6 +19,8 @@
 
 #include "Arduino.h"
 #include "Wire.h"
+#include "I2CAsync.h"
+#include "PowerSensor.h"
 
 // Default address of the TCA9548APWR multiplexer
 #define MUX_ADDR 0x75
@@ -26,8 +28,35 @@
 #define STD_ADDR 0x40
 
 // INA226 registers addresses
+#define CONFIG_REG 0x00
+#define BUS_REG  0x02
+#define CUR_REG  0x04
 #define CAL_REG  0x05
 #define PWR_REG  0x03
+#define MASK_REG  0x06
+#define ALERT_REG 0x07
+
+#define MFG_ID_REG 0xFE
+#define DIE_ID_REG 0xFF
+
+// Mask/Enable: Power Over-Limit alert function, Conversion Ready flag
+#define MASK_POL  0x0800
+#define MASK_CVRF 0x0008
+
+// Configuration words: power-on default; no averaging, 140 us conversions
+// with the shunt converted continuously or the bus once
+#define CONFIG_RESET      0x4127
+#define CONFIG_SHUNT_CONT 0x4005
+#define CONFIG_BUS_TRIG   0x4002
+// Bus voltage LSB in microvolts, and the longest wait for a bus conversion
+#define BUS_LSB_UV 1250
+#define BUS_CONV_TIMEOUT_US 1000
+
+// Identification words and address range (A1/A0 strapping) of the INA226
+#define INA226_MFG_ID 0x5449
+#define INA226_DIE_ID 0x2260
+#define INA226_ADDR_FIRST 0x40
+#define INA226_ADDR_LAST  0x4F
 
 // List of currently supported boards
 typedef enum board {
@@ -49,7 +78,13 @@ static const uint16_t cal_reg[NUM_BOARDS][2] = {{0x0D1B, 0x0800}, {0x0800, 0x083
 // LSB value obtained through datasheet
 static const float lsb_val[NUM_SENS][2] = {{0.0003052, 0.00125}, {0.0005, 0.0012208}};
 
-class INA226 {
+// Where a rail's monitor sits: mux channel and INA226 address
+typedef struct rail_loc {
+    uint8_t mux;
+    uint8_t addr;
+} rail_loc_typeDef;
+
+class INA226 : public PowerSensor {
 public:
     // Constructor with default address
     explicit INA226(const board_typeDef &board, TwoWire *wire = &Wire);
@@ -57,15 +92,77 @@ public:
     explicit INA226(const uint8_t &addr, const board_typeDef &board, TwoWire *wire = &Wire);
     
     const float get_pwr(const sensor_typeDef &sensor);
+    // Raw power register, -1 on bus error
+    const int32_t get_pwr_raw(const sensor_typeDef &sensor);
+    // Power register LSB in microwatts (25 × current LSB)
+    const uint32_t pwr_lsb_uw(const sensor_typeDef &sensor);
+    // Assert ALERT (open-drain, active low, transparent) while the power of
+    // `sensor` is above `watts`; 0 disables the alert
+    const int8_t set_pwr_limit(const sensor_typeDef &sensor, const float &watts);
+    // Shunt-only mode: the monitors convert the shunt continuously at the
+    // fastest rate and the Current register is read instead of the Power one,
+    // 25x finer. The Power register and its alert stop updating.
+    const void set_shunt_only(const bool &on);
+    // Raw current register, negative currents read as 0, -1 on bus error
+    const int32_t get_cur_raw(const sensor_typeDef &sensor);
+    // Current register LSB in nanoamps, the real LSBs are not whole µA
+    const uint32_t cur_lsb_na(const sensor_typeDef &sensor);
+    // One triggered bus conversion in shunt-only mode, then back to shunt
+    // conversions; raw bus voltage (BUS_LSB_UV), -1 on bus error or timeout
+    const int32_t get_bus_raw(const sensor_typeDef &sensor);
+    // PowerSensor interface, channels are sensor_typeDef values. In
+    // shunt-only mode the readings are currents, their LSB rounded to µA
+    // (cur_lsb_na() has it exactly).
+    const int32_t read_raw(const uint8_t &channel) override {
+        return _shunt_only ? get_cur_raw((sensor_typeDef)channel) : get_pwr_raw((sensor_typeDef)channel);
+    }
+    const uint32_t raw_lsb_uw(const uint8_t &channel) override {
+        return _shunt_only ? (cur_lsb_na((sensor_typeDef)channel) + 500) / 1000 : pwr_lsb_uw((sensor_typeDef)channel);
+    }
     const void set_I2C_speed(const uint16_t &speed);
     const void set_addr(const uint8_t &addr);
 
+    // Walk every mux channel and the INA226 address range, identifying
+    // devices by their Manufacturer/Die ID; only the first one on each
+    // channel is taken. Returns the number found.
+    const uint8_t scan(rail_loc_typeDef *found, const uint8_t &max);
+    // Route the mux to `channel` for another device on the bus; the next
+    // access to a rail routes it back
+    const int8_t route_mux(const uint8_t &channel);
+    // Move a rail; call calibrate() once the table is complete
+    const void set_rail(const sensor_typeDef &sensor, const rail_loc_typeDef &loc);
+    const rail_loc_typeDef get_rail(const sensor_typeDef &sensor) { return _rail[sensor]; }
+    const void calibrate();
+    // Configuration register (averaging, conversion times, mode) of every rail
+    const void set_config(const uint16_t &config);
+
+    // Non-blocking readout: queue the mux switch and the power register read
+    // on the bus, then poll pwr_ready() and fetch the value with take_pwr().
+    // Do not mix with get_pwr() while requests are in flight.
+    const bool request_pwr(const sensor_typeDef &sensor);
+    const bool pwr_ready(const sensor_typeDef &sensor);
+    const float take_pwr(const sensor_typeDef &sensor);
+    const int32_t take_pwr_raw(const sensor_typeDef &sensor);
+
 private:
 
     uint8_t _address;
     board_typeDef _board;
     TwoWire * _wire;
+    // Mux channel currently routed on this bus (or that will be, once the
+    // queued transfers complete), NUM_SENS if unknown
+    sensor_typeDef _cur_sensor;
+    // Rail table, by default rail i on mux channel i at _address
+    rail_loc_typeDef _rail[NUM_SENS];
+    bool _shunt_only;
+
+    I2CAsync _bus;
+    i2c_xfer_typeDef _mux_xfer[NUM_SENS];
+    i2c_xfer_typeDef _pwr_xfer[NUM_SENS];
 
+    const uint8_t _mux_channels();
+    const uint8_t _mux_code(const uint8_t &channel);
+    static void _on_mux_done(i2c_xfer_typeDef *xfer, void *ctx);
     void _sel_sensor(const sensor_typeDef &sensor);
     const int8_t _write_reg(const uint8_t &reg, const uint16_t &val);
     int32_t _read_reg(const uint8_t &reg);
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "PMBus.h"
+
+PMBus::PMBus(INA226 *mux, const uint8_t &mux_ch, TwoWire *wire, const bool &pec)
+    : _mux(mux),
+      _mux_ch(mux_ch),
+      _wire(wire),
+      _pec(pec),
+      _num_rails(0),
+      _rail(),
+      _cur_addr(0),
+      _cur_page(0xff)
+{
+}
+
+const bool PMBus::add_rail(const uint8_t &addr, const uint8_t &page) {
+    if (_num_rails == PMBUS_MAX_RAILS) return false;
+
+    uint8_t ch = _num_rails++;
+    pmbus_rail_typeDef *rail = &_rail[ch];
+    rail->addr = addr;
+    rail->page = page;
+    if (_route() != 0 || _sel_page(ch) != 0) return false;
+
+    // VOUT_MODE: mode in bits 7:5 (000 = linear), exponent in bits 4:0
+    int32_t mode = _read(addr, PMBUS_VOUT_MODE, 1);
+    rail->has_vout = (mode >= 0) && ((mode & 0xE0) == 0);
+    rail->vout_exp = (int8_t)(mode << 3) >> 3;
+    rail->has_pout = _read(addr, PMBUS_READ_POUT, 2) >= 0;
+    return rail->has_pout || rail->has_vout;
+}
+
+const int32_t PMBus::read_raw(const uint8_t &channel) {
+    const pmbus_rail_typeDef *rail = &_rail[channel];
+    if (_route() != 0 || _sel_page(channel) != 0) return -1;
+
+    // -1 is the error value, so a regulator sinking power reads 0
+    if (rail->has_pout) {
+        int32_t word = _read(rail->addr, PMBUS_READ_POUT, 2);
+        return (word < 0) ? -1 : max(linear11(word, 1000), (int32_t)0);
+    }
+
+    int32_t ma, mv;
+    if (!get_iout_ma(channel, ma) || !get_vout_mv(channel, mv)) return -1;
+    return (int32_t)max(((int64_t)ma * mv + 500) / 1000, (int64_t)0);
+}
+
+const bool PMBus::get_iout_ma(const uint8_t &channel, int32_t &ma) {
+    if (_route() != 0 || _sel_page(channel) != 0) return false;
+    int32_t word = _read(_rail[channel].addr, PMBUS_READ_IOUT, 2);
+    if (word < 0) return false;
+    ma = linear11(word, 1000);
+    return true;
+}
+
+const bool PMBus::get_vout_mv(const uint8_t &channel, int32_t &mv) {
+    const pmbus_rail_typeDef *rail = &_rail[channel];
+    if (!rail->has_vout || _route() != 0 || _sel_page(channel) != 0) return false;
+    int32_t word = _read(rail->addr, PMBUS_READ_VOUT, 2);
+    if (word < 0) return false;
+    mv = linear16(word, rail->vout_exp, 1000);
+    return true;
+}
+
+const int8_t PMBus::read_block(const uint8_t &addr, const uint8_t &cmd, uint8_t *buf, const uint8_t &max) {
+    uint8_t crc = 0;
+    if (_route() != 0) return -1;
+
+    // The count byte first, then the whole block again with exactly that
+    // many bytes: reading past the block returns padding or a NAK
+    if (_command(addr, cmd) != 0 || _wire->requestFrom(addr, (uint8_t)1) != 1) return -1;
+    uint8_t count = _wire->read();
+    if (count > PMBUS_BLOCK_MAX) return -1;
+
+    uint8_t want = 1 + count + (_pec ? 1 : 0);
+    if (_command(addr, cmd) != 0 || _wire->requestFrom(addr, want) != want) return -1;
+    if (_wire->read() != count) return -1;
+    crc = _crc8(_crc8(_crc8(_crc8(crc, addr << 1), cmd), (addr << 1) | 1), count);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t b = _wire->read();
+        crc = _crc8(crc, b);
+        if (i < max) buf[i] = b;
+    }
+    if (_pec && _wire->read() != crc) return -1;
+    while (_wire->available()) _wire->read();
+
+    return (count < max) ? count : max;
+}
+
+const int32_t PMBus::linear11(const uint16_t &word, const int32_t &scale) {
+    // 11-bit two's complement mantissa, 5-bit two's complement exponent
+    int64_t val = (int64_t)((int16_t)(word << 5) >> 5) * scale;
+    int8_t exp = (int8_t)((word >> 11) << 3) >> 3;
+    if (exp >= 0) return (int32_t)(val << exp);
+    return (int32_t)((val + (1LL << (-exp - 1))) >> -exp);
+}
+
+const int32_t PMBus::linear16(const uint16_t &word, const int8_t &exp, const int32_t &scale) {
+    // Unsigned mantissa, exponent taken from VOUT_MODE
+    int64_t val = (int64_t)word * scale;
+    if (exp >= 0) return (int32_t)(val << exp);
+    return (int32_t)((val + (1LL << (-exp - 1))) >> -exp);
+}
+
+const int8_t PMBus::_route() {
+    // The INA226 driver moves the mux between rails, route it every time
+    return _mux ? _mux->route_mux(_mux_ch) : 0;
+}
+
+const int8_t PMBus::_command(const uint8_t &addr, const uint8_t &cmd) {
+    // Repeated start follows
+    _wire->beginTransmission(addr);
+    _wire->write(cmd);
+    return _wire->endTransmission(false);
+}
+
+const int8_t PMBus::_sel_page(const uint8_t &channel) {
+    const pmbus_rail_typeDef *rail = &_rail[channel];
+    if (rail->addr == _cur_addr && rail->page == _cur_page) return 0;
+
+    int8_t ret = _write_byte(rail->addr, PMBUS_PAGE, rail->page);
+    _cur_addr = rail->addr;
+    _cur_page = (ret == 0) ? rail->page : 0xff;
+    return ret;
+}
+
+const int8_t PMBus::_write_byte(const uint8_t &addr, const uint8_t &cmd, const uint8_t &val) {
+    _wire->beginTransmission(addr);
+    _wire->write(cmd);
+    _wire->write(val);
+    if (_pec) _wire->write(_crc8(_crc8(_crc8(0, addr << 1), cmd), val));
+    return _wire->endTransmission();
+}
+
+int32_t PMBus::_read(const uint8_t &addr, const uint8_t &cmd, const uint8_t &len) {
+    uint8_t n = len + (_pec ? 1 : 0);
+    uint8_t crc = _crc8(_crc8(_crc8(0, addr << 1), cmd), (addr << 1) | 1);
+    int32_t val = 0;
+
+    // Repeated start between the command and the data phase
+    if (_command(addr, cmd) != 0) return -1;
+    if (_wire->requestFrom(addr, n) != n) return -1;
+
+    // SMBus words are sent low byte first
+    for (uint8_t i = 0; i < len; i++) {
+        uint8_t b = _wire->read();
+        crc = _crc8(crc, b);
+        val |= (int32_t)b << (8 * i);
+    }
+    if (_pec && _wire->read() != crc) return -1;
+    return val;
+}
+
+uint8_t PMBus::_crc8(uint8_t crc, const uint8_t &data) {
+    // SMBus PEC: CRC-8, polynomial x^8 + x^2 + x + 1
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    return crc;
+}
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef PMBUS_H
+#define PMBUS_H
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "PowerSensor.h"
+#include "INA226.h"
+
+// PMBus commands
+#define PMBUS_PAGE      0x00
+#define PMBUS_VOUT_MODE 0x20
+#define PMBUS_READ_VOUT 0x8B
+#define PMBUS_READ_IOUT 0x8C
+#define PMBUS_READ_POUT 0x96
+#define PMBUS_MFR_ID    0x99
+#define PMBUS_MFR_MODEL 0x9A
+
+#define PMBUS_MAX_RAILS 6
+// Mux channel of the regulators on ZCU102/ZCU106 (MAXIM_PMBUS)
+#ifndef PMBUS_MUX_CH
+  #define PMBUS_MUX_CH 2
+#endif
+// Longest block read, without the byte count
+#define PMBUS_BLOCK_MAX 32
+
+// One regulator output: device address and PMBus page
+typedef struct pmbus_rail {
+    uint8_t addr;
+    uint8_t page;
+    int8_t vout_exp;    // LINEAR16 exponent from VOUT_MODE
+    bool has_pout;      // READ_POUT supported, else IOUT × VOUT
+    bool has_vout;      // VOUT_MODE is linear
+} pmbus_rail_typeDef;
+
+// Output telemetry of PMBus regulators. Raw power is reported in mW
+// (raw_lsb_uw() = 1000), read from READ_POUT or, on devices without it,
+// from READ_IOUT × READ_VOUT; negative power reads as 0. The regulators sit
+// behind the INA226 mux: every transfer first routes it to their channel.
+class PMBus : public PowerSensor {
+public:
+    // `mux` owns the mux the regulators sit behind, on `mux_ch`
+    explicit PMBus(INA226 *mux, const uint8_t &mux_ch = PMBUS_MUX_CH, TwoWire *wire = &Wire, const bool &pec = false);
+
+    // Append an output as the next channel, false if the device did not
+    // answer (the channel then reads -1)
+    const bool add_rail(const uint8_t &addr, const uint8_t &page);
+    const uint8_t num_rails() { return _num_rails; }
+    const pmbus_rail_typeDef get_rail(const uint8_t &channel) { return _rail[channel]; }
+
+    const int32_t read_raw(const uint8_t &channel) override;
+    const uint32_t raw_lsb_uw(const uint8_t &) override { return 1000; }
+
+    // Telemetry in mA / mV, false on error
+    const bool get_iout_ma(const uint8_t &channel, int32_t &ma);
+    const bool get_vout_mv(const uint8_t &channel, int32_t &mv);
+    // Block read into `buf`, returns the byte count or -1
+    const int8_t read_block(const uint8_t &addr, const uint8_t &cmd, uint8_t *buf, const uint8_t &max);
+
+    // value × `scale`, rounded, from the two PMBus numeric formats
+    static const int32_t linear11(const uint16_t &word, const int32_t &scale);
+    static const int32_t linear16(const uint16_t &word, const int8_t &exp, const int32_t &scale);
+
+private:
+    INA226 * _mux;
+    uint8_t _mux_ch;
+    TwoWire * _wire;
+    bool _pec;
+    uint8_t _num_rails;
+    pmbus_rail_typeDef _rail[PMBUS_MAX_RAILS];
+    // Page last selected, to skip redundant PAGE writes
+    uint8_t _cur_addr;
+    uint8_t _cur_page;
+
+    const int8_t _route();
+    const int8_t _sel_page(const uint8_t &channel);
+    const int8_t _command(const uint8_t &addr, const uint8_t &cmd);
+    const int8_t _write_byte(const uint8_t &addr, const uint8_t &cmd, const uint8_t &val);
+    int32_t _read(const uint8_t &addr, const uint8_t &cmd, const uint8_t &len);
+    static uint8_t _crc8(uint8_t crc, const uint8_t &data);
+};
+
+#endif // PMBUS_H
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "PowerHist.h"
+
+PowerHist::PowerHist() {
+    reset();
+}
+
+void PowerHist::reset() {
+    _samples = 0;
+    memset(_errors, 0, sizeof(_errors));
+    memset(_bins, 0, sizeof(_bins));
+}
+
+const uint16_t PowerHist::_bin(const uint32_t &val) {
+    if (val < (2 << HIST_SUB_BITS)) return val;
+    uint8_t shift = (31 - __builtin_clz(val)) - HIST_SUB_BITS;
+    return (shift << HIST_SUB_BITS) + (val >> shift);
+}
+
+void PowerHist::add(const uint32_t &t, const int32_t *raw) {
+    if (_samples++ == 0) _t_start = t;
+    _t_end = t;
+
+    for (int i = 0; i < NUM_RAILS; i++) {
+        if (raw[i] < 0 || raw[i] >= (1L << HIST_RAW_BITS)) _errors[i]++;
+        else _bins[i][_bin(raw[i])]++;
+    }
+}
+
+void PowerHist::emit(Print *out, const uint32_t *lsb_uw) {
+    if (empty()) return;
+
+    for (int i = 0; i < NUM_RAILS; i++) {
+        out->print(F("#HIST\t"));
+        out->print(i);
+        out->print('\t');
+        out->print(_t_start);
+        out->print('\t');
+        out->print(_t_end);
+        out->print('\t');
+        out->print(lsb_uw[i]);
+        out->print('\t');
+        out->print(_errors[i]);
+        out->print('\t');
+
+        bool first = true;
+        for (int b = 0; b < HIST_BINS; b++) {
+            if (_bins[i][b] == 0) continue;
+            if (!first) out->print(',');
+            out->print(b);
+            out->print(':');
+            out->print(_bins[i][b]);
+            first = false;
+        }
+        out->println();
+    }
+    reset();
+}
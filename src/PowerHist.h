@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef POWER_HIST_H
+#define POWER_HIST_H
+
+#include "INA226.h"
+
+// Log-linear bins: values below 2^(HIST_SUB_BITS+1) get their own bin, every
+// octave above is split into 2^HIST_SUB_BITS bins (≤ 6.25 % bin width)
+#define HIST_SUB_BITS 4
+// Range of the raw values: the INA226 registers are 16 bits, PMBus rails
+// report mW and may go past 65.5 W
+#if PMBUS_RAILS > 0
+  #define HIST_RAW_BITS 24
+#else
+  #define HIST_RAW_BITS 16
+#endif
+#define HIST_BINS ((HIST_RAW_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+// Per-rail histograms of the raw power register over a window. At the end of
+// the window each rail is sent as one sparse line:
+//
+//   #HIST <rail> <t_start> <t_end> <lsb_uw> <errors> <bin>:<count>,...
+//
+// and the host derives percentiles from the bin bounds.
+class PowerHist {
+public:
+    PowerHist();
+
+    void add(const uint32_t &t, const int32_t *raw);
+    bool empty() const { return _samples == 0; }
+    uint32_t t_start() const { return _t_start; }
+    // Send every rail and start a new window
+    void emit(Print *out, const uint32_t *lsb_uw);
+    void reset();
+
+private:
+    uint32_t _t_start;
+    uint32_t _t_end;
+    uint32_t _samples;
+    uint32_t _errors[NUM_RAILS];
+    uint32_t _bins[NUM_RAILS][HIST_BINS];
+
+    static const uint16_t _bin(const uint32_t &val);
+};
+
+#endif // POWER_HIST_H
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef POWER_SENSOR_H
+#define POWER_SENSOR_H
+
+#include <stdint.h>
+
+// PMBus regulator outputs logged after the INA226 rails
+#ifndef PMBUS_RAILS
+  #define PMBUS_RAILS 0
+#endif
+
+// Columns of every record: the INA226 rails (NUM_SENS) then the PMBus ones
+#define NUM_RAILS (NUM_SENS + PMBUS_RAILS)
+
+// What the acquisition loop needs from a power monitor: a raw reading per
+// channel and the size of its unit. Raw values stay integers up to the
+// output stage, so the encoders treat every backend alike.
+class PowerSensor {
+public:
+    // Raw power of `channel`, -1 on bus error
+    virtual const int32_t read_raw(const uint8_t &channel) = 0;
+    // Value of one raw unit in microwatts
+    virtual const uint32_t raw_lsb_uw(const uint8_t &channel) = 0;
+};
+
+#endif // POWER_SENSOR_H
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "Profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Changes with the layout of profile_table_typeDef
+#define PROFILE_MAGIC 0x50524F31UL
+
+// INA226 averaging counts and conversion times, indexed by field code
+static const uint16_t ina_avg[8] = {1, 4, 16, 64, 128, 256, 512, 1024};
+static const uint16_t ina_ct_us[8] = {140, 204, 332, 588, 1100, 2116, 4156, 8244};
+
+ProfileStore::ProfileStore(const board_typeDef &board)
+    : _flash(PROFILE_STORE_SLOT),
+      _board(board),
+      _table()
+{
+}
+
+bool ProfileStore::begin(const profile_typeDef &defaults) {
+    bool loaded = _flash.load(&_table, sizeof(_table), PROFILE_MAGIC) &&
+        _table.count > 0 && _table.count <= PROFILE_SLOTS && _table.active < _table.count;
+    if (loaded && _table.profile[_table.active].board == _board) return true;
+
+    if (loaded) {
+        // Flashed onto another board: fall back to a profile made for this
+        // one, in RAM until the table is next saved
+        for (uint8_t i = 0; i < _table.count; i++) {
+            if (_table.profile[i].board == _board) {
+                _table.active = i;
+                return false;
+            }
+        }
+        if (_table.count < PROFILE_SLOTS && find(defaults.name) < 0) {
+            _table.active = _table.count++;
+            _table.profile[_table.active] = defaults;
+            _table.profile[_table.active].board = _board;
+            return false;
+        }
+    }
+
+    memset(&_table, 0, sizeof(_table));
+    _table.profile[0] = defaults;
+    _table.profile[0].board = _board;
+    _table.count = 1;
+    return !loaded;
+}
+
+const int8_t ProfileStore::find(const char *name) {
+    for (uint8_t i = 0; i < _table.count; i++) {
+        if (strncmp(_table.profile[i].name, name, PROFILE_NAME_LEN) == 0) return i;
+    }
+    return -1;
+}
+
+bool ProfileStore::select(const char *name) {
+    int8_t idx = find(name);
+    if (idx < 0 || _table.profile[idx].board != _board) return false;
+    if (idx != _table.active) {
+        _table.active = idx;
+        _save();
+    }
+    return true;
+}
+
+bool ProfileStore::set(const char *name, const char *pairs) {
+    if (strlen(name) == 0 || strlen(name) >= PROFILE_NAME_LEN) return false;
+
+    int8_t idx = find(name);
+    profile_typeDef p = (idx < 0) ? *active() : _table.profile[idx];
+    strncpy(p.name, name, PROFILE_NAME_LEN);
+    p.board = _board;
+    if (!_parse(&p, pairs)) return false;
+
+    if (idx < 0) {
+        if (_table.count == PROFILE_SLOTS) return false;
+        idx = _table.count++;
+    }
+    _table.profile[idx] = p;
+    _save();
+    return true;
+}
+
+bool ProfileStore::remove(const char *name) {
+    int8_t idx = find(name);
+    if (idx < 0 || _table.count == 1) return false;
+
+    for (uint8_t i = idx; i + 1 < _table.count; i++) _table.profile[i] = _table.profile[i + 1];
+    _table.count--;
+    if (_table.active == idx) _table.active = 0;
+    else if (_table.active > idx) _table.active--;
+    _save();
+    return true;
+}
+
+bool ProfileStore::_save() {
+    return _flash.save(&_table, sizeof(_table), PROFILE_MAGIC);
+}
+
+bool ProfileStore::_parse(profile_typeDef *p, const char *pairs) {
+    while (*pairs) {
+        while (*pairs == ' ') pairs++;
+        if (!*pairs) break;
+
+        const char *eq = strchr(pairs, '=');
+        if (!eq) return false;
+        size_t key_len = eq - pairs;
+        const char *val = eq + 1;
+        // The whole value must be a number, a whole one for the integer keys
+        char *end;
+        long num = strtol(val, &end, 0);
+        bool is_int = (end != val) && (*end == ' ' || *end == '\0');
+        double real = strtod(val, &end);
+        bool is_real = (end != val) && (*end == ' ' || *end == '\0');
+        if (!is_real) return false;
+
+        if (key_len == 3 && strncmp(pairs, "avg", 3) == 0) {
+            if (!is_int || num < 0) return false;
+            uint8_t code = 0;
+            while (code < 7 && ina_avg[code] < num) code++;
+            // AVG, bits 11:9
+            p->ina_config = (p->ina_config & ~(0x7 << 9)) | (code << 9);
+        } else if (key_len == 5 && strncmp(pairs, "ct_us", 5) == 0) {
+            // Same conversion time for bus (VBUSCT, 8:6) and shunt (VSHCT, 5:3)
+            if (!is_int || num < 0) return false;
+            uint8_t code = 0;
+            while (code < 7 && ina_ct_us[code] < num) code++;
+            p->ina_config = (p->ina_config & ~(0x3f << 3)) | (code << 6) | (code << 3);
+        } else if (key_len == 9 && strncmp(pairs, "period_us", 9) == 0) {
+            if (!is_int || num < 0) return false;
+            p->period_us = num;
+        } else if (key_len == 7 && strncmp(pairs, "trigger", 7) == 0) {
+            if (!is_int) return false;
+            p->trigger = (num != 0);
+        } else if (key_len == 8 && strncmp(pairs, "limit_ps", 8) == 0) {
+            p->pwr_limit_w[PS] = real;
+        } else if (key_len == 8 && strncmp(pairs, "limit_pl", 8) == 0) {
+            p->pwr_limit_w[PL] = real;
+        } else {
+            return false;
+        }
+
+        while (*pairs && *pairs != ' ') pairs++;
+    }
+    return true;
+}
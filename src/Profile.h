@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "INA226.h"
+#include "FlashStore.h"
+
+#define PROFILE_SLOTS 4
+#define PROFILE_NAME_LEN 16
+// Flash slot of the profile table, next to the rail table (slot 0)
+#define PROFILE_STORE_SLOT 1
+
+// INA226 configuration register at power-on: 1 sample, 1.1 ms
+// conversions, continuous shunt and bus
+#define INA_CONFIG_DEFAULT 0x4127
+
+// One experiment setup, applied without recompiling. Fields that the build
+// has no use for (e.g. power limits without POWER_ALERT) are kept but ignored.
+typedef struct profile {
+    char name[PROFILE_NAME_LEN];
+    uint8_t board;          // board_typeDef it was made for
+    uint8_t trigger;        // follow the external trigger, else log freely
+    uint16_t ina_config;    // INA226 averaging and conversion times
+    uint32_t period_us;     // sample period, 0 = as fast as the loop runs
+    float pwr_limit_w[NUM_SENS];
+} profile_typeDef;
+
+// Named profiles kept in internal flash along with the active one. Changes
+// apply in RAM even where flash is not available, for the session only.
+class ProfileStore {
+public:
+    explicit ProfileStore(const board_typeDef &board);
+
+    // Load the table, or start one holding `defaults` alone. False when the
+    // stored active profile was made for another board and was refused.
+    bool begin(const profile_typeDef &defaults);
+
+    const uint8_t count() { return _table.count; }
+    const profile_typeDef *get(const uint8_t &idx) { return &_table.profile[idx]; }
+    const profile_typeDef *active() { return &_table.profile[_table.active]; }
+    // -1 if there is no such profile
+    const int8_t find(const char *name);
+
+    // Make `name` active, false if unknown or made for another board
+    bool select(const char *name);
+    // Create or update `name` from space separated key=value pairs (avg,
+    // ct_us, period_us, trigger, limit_ps, limit_pl), starting from the
+    // active profile. False on a bad pair (unknown key, value that is not a
+    // number, negative count or period) or when every slot is taken.
+    bool set(const char *name, const char *pairs);
+    // The last profile cannot be removed
+    bool remove(const char *name);
+
+private:
+    typedef struct profile_table {
+        uint8_t active;
+        uint8_t count;
+        profile_typeDef profile[PROFILE_SLOTS];
+    } profile_table_typeDef;
+
+    FlashStore _flash;
+    uint8_t _board;
+    profile_table_typeDef _table;
+
+    bool _save();
+    static bool _parse(profile_typeDef *p, const char *pairs);
+};
+
+#endif // PROFILE_H
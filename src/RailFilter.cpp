@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "RailFilter.h"
+
+RailFilter::RailFilter(const uint16_t &decimate)
+    : _decimate(decimate ? decimate : 1)
+{
+#ifdef FILTER_FIR
+    _design();
+#endif
+    reset();
+}
+
+void RailFilter::reset() {
+    _phase = 0;
+    _primed = false;
+#if defined(FILTER_MA)
+    _pos = 0;
+    memset(_sum, 0, sizeof(_sum));
+#elif defined(FILTER_FIR)
+    _pos = 0;
+    memset(_shift, 0, sizeof(_shift));
+#endif
+}
+
+bool RailFilter::push(const int32_t *raw, int32_t *out) {
+    bool primed = !_primed;
+    _primed = true;
+
+    for (int i = 0; i < NUM_RAILS; i++) {
+#if defined(FILTER_MA)
+        if (primed) {
+            // Start from a full window of the first value, not of zeros
+            for (int j = 0; j < FILTER_TAPS; j++) _hist[i][j] = raw[i];
+            _sum[i] = raw[i] * FILTER_TAPS;
+        }
+        _sum[i] += raw[i] - _hist[i][_pos];
+        _hist[i][_pos] = raw[i];
+#elif defined(FILTER_IIR)
+        if (primed) _acc[i] = raw[i] * 256;
+        _acc[i] += (raw[i] * 256 - _acc[i]) >> FILTER_SHIFT;
+#else
+        int32_t v = max(raw[i], (int32_t)0);
+        while ((v >> _shift[i]) > 65535) _widen(i);
+        int32_t half = _shift[i] ? 1L << (_shift[i] - 1) : 0;
+        int16_t x = (int16_t)(min((v + half) >> _shift[i], (int32_t)65535) - 32768);
+        if (primed) {
+            for (int j = 0; j < 2 * FILTER_TAPS; j++) _hist[i][j] = x;
+        }
+        _hist[i][_pos] = x;
+        _hist[i][_pos + FILTER_TAPS] = x;
+#endif
+    }
+
+#if defined(FILTER_MA) || defined(FILTER_FIR)
+    _pos = (_pos + 1) % FILTER_TAPS;
+#endif
+
+    // Only every _decimate-th output is computed and sent
+    if (++_phase < _decimate) return false;
+    _phase = 0;
+
+    for (int i = 0; i < NUM_RAILS; i++) {
+#if defined(FILTER_MA)
+        out[i] = (_sum[i] + FILTER_TAPS / 2) / FILTER_TAPS;
+#elif defined(FILTER_IIR)
+        out[i] = (_acc[i] + 128) >> 8;
+#else
+        out[i] = _dot(&_hist[i][_pos]) << _shift[i];
+#endif
+    }
+    return true;
+}
+
+#ifdef FILTER_FIR
+void RailFilter::_design() {
+    // Hamming-windowed sinc, cut-off at the Nyquist frequency of the
+    // decimated stream, normalised to unity DC gain
+    float h[FILTER_TAPS];
+    float fc = 0.5f / _decimate;
+    float sum = 0;
+    for (int j = 0; j < FILTER_TAPS; j++) {
+        float m = j - (FILTER_TAPS - 1) / 2.0f;
+        float sinc = (m == 0) ? 2 * fc : sinf(2 * PI * fc * m) / (PI * m);
+        h[j] = sinc * (0.54f - 0.46f * cosf(2 * PI * j / (FILTER_TAPS - 1)));
+        sum += h[j];
+    }
+
+    // Q15 taps summing to exactly 32768 (unity gain), the rounding residual
+    // goes to a centre tap, the largest one
+    int32_t total = 0;
+    for (int j = 0; j < FILTER_TAPS; j++) {
+        _coef[FILTER_TAPS - 1 - j] = (int16_t)lroundf(h[j] / sum * 32768);
+        total += _coef[FILTER_TAPS - 1 - j];
+    }
+    _coef[FILTER_TAPS / 2] += 32768 - total;
+    total = 32768;
+    // Adds back the -32768 offset of the stored samples
+    _bias = (int64_t)total * 32768;
+}
+
+void RailFilter::_widen(const uint8_t &rail) {
+    // Halve the stored history so it stays on the new scale
+    for (int j = 0; j < 2 * FILTER_TAPS; j++)
+        _hist[rail][j] = (int16_t)((((int32_t)_hist[rail][j] + 32768 + 1) >> 1) - 32768);
+    _shift[rail]++;
+}
+
+const int32_t RailFilter::_dot(const int16_t *x) {
+    int64_t acc = _bias;
+#ifdef FILTER_SIMD
+    // Two taps per instruction; Cortex-M4 allows unaligned word loads
+    for (int j = 0; j < FILTER_TAPS; j += 2) {
+        uint32_t xx, hh;
+        memcpy(&xx, &x[j], sizeof(xx));
+        memcpy(&hh, &_coef[j], sizeof(hh));
+        acc = __SMLALD(xx, hh, acc);
+    }
+#else
+    for (int j = 0; j < FILTER_TAPS; j++) acc += (int32_t)x[j] * _coef[j];
+#endif
+    // Q15 → raw, rounded
+    return (int32_t)((acc + (1 << 14)) >> 15);
+}
+#endif
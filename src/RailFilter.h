@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RAIL_FILTER_H
+#define RAIL_FILTER_H
+
+#include "INA226.h"
+
+// Filter type: FILTER_MA (moving average), FILTER_IIR (first-order
+// exponential) or FILTER_FIR (windowed-sinc low-pass at the decimated Nyquist)
+#if !defined(FILTER_MA) && !defined(FILTER_IIR) && !defined(FILTER_FIR)
+  #define FILTER_MA
+#endif
+// Moving average / FIR length
+#ifndef FILTER_TAPS
+  #define FILTER_TAPS 16
+#endif
+// IIR smoothing, y += (x - y) / 2^FILTER_SHIFT
+#ifndef FILTER_SHIFT
+  #define FILTER_SHIFT 3
+#endif
+
+// Cortex-M4F: dual 16-bit MACs (SMLALD) through the CMSIS core intrinsics
+#if defined(ARDUINO_ARCH_MBED) && defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+  #define FILTER_SIMD
+  #include "cmsis.h"
+#endif
+
+#if defined(FILTER_FIR) && (FILTER_TAPS % 2)
+  #error "FILTER_TAPS must be even for the FIR filter"
+#endif
+
+// Per-rail low-pass filter followed by decimation, applied to raw power
+// registers. Filtering at the full rate before dropping samples keeps
+// content above the output Nyquist from aliasing into the decimated stream.
+class RailFilter {
+public:
+    explicit RailFilter(const uint16_t &decimate);
+
+    // Feed one record, true when a decimated output is ready in `out`
+    bool push(const int32_t *raw, int32_t *out);
+    // Forget the history, e.g. at the start of a trigger window
+    void reset();
+
+private:
+    uint16_t _decimate;
+    uint16_t _phase;
+    bool _primed;
+
+#if defined(FILTER_MA)
+    uint8_t _pos;
+    int32_t _sum[NUM_RAILS];
+    int32_t _hist[NUM_RAILS][FILTER_TAPS];
+#elif defined(FILTER_IIR)
+    // Q8 state
+    int32_t _acc[NUM_RAILS];
+#else
+    uint8_t _pos;
+    // Q15 taps, reversed so the newest sample meets _coef[FILTER_TAPS - 1]
+    int16_t _coef[FILTER_TAPS];
+    int64_t _bias;
+    // Samples shifted right by _shift and offset by -32768 to fit int16,
+    // stored twice so the window is always contiguous. The shift only grows
+    // for rails past 16 bits (PMBus rails in mW above 65.5 W).
+    int16_t _hist[NUM_RAILS][2 * FILTER_TAPS];
+    uint8_t _shift[NUM_RAILS];
+
+    void _design();
+    void _widen(const uint8_t &rail);
+    const int32_t _dot(const int16_t *x);
+#endif
+};
+
+#endif // RAIL_FILTER_H
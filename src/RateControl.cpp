@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "RateControl.h"
+
+RateControl::RateControl(const uint32_t &fast_us, const uint32_t &slow_us, const uint16_t &delta_lsb,
+                         const uint32_t &var_lsb2, const uint32_t &hold_us)
+    : _fast_us(fast_us),
+      _slow_us(slow_us),
+      _delta_lsb(delta_lsb),
+      _var_lsb2(var_lsb2),
+      _hold_us(hold_us),
+      _primed(false),
+      _fast(false),
+      _last_active(0)
+{
+}
+
+uint32_t RateControl::update(const uint32_t &t, const int32_t *raw) {
+    bool active = false;
+
+    for (int i = 0; i < NUM_RAILS; i++) {
+        // Bus errors neither trigger nor feed the statistics
+        if (raw[i] < 0) continue;
+
+        if (!_primed) {
+            _prev[i] = raw[i];
+            _mean[i] = raw[i] << 8;
+            _var[i] = 0;
+            continue;
+        }
+
+        int32_t step = raw[i] - _prev[i];
+        _prev[i] = raw[i];
+
+        int32_t dev = (raw[i] << 8) - _mean[i];
+        _mean[i] += dev >> RATE_EWMA_SHIFT;
+        int64_t sq = ((int64_t)dev * dev) >> 16;
+        _var[i] += (int32_t)((sq - (int64_t)_var[i]) >> RATE_EWMA_SHIFT);
+
+        if (step > _delta_lsb || step < -(int32_t)_delta_lsb || _var[i] > _var_lsb2) active = true;
+    }
+    _primed = true;
+
+    if (active) {
+        _fast = true;
+        _last_active = t;
+    } else if (_fast && (uint32_t)(t - _last_active) >= _hold_us) {
+        _fast = false;
+    }
+    return period();
+}
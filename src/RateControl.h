@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+
+#include "INA226.h"
+
+// EWMA weight of the running mean/variance, 1 / 2^RATE_EWMA_SHIFT
+#ifndef RATE_EWMA_SHIFT
+  #define RATE_EWMA_SHIFT 4
+#endif
+
+// Activity-driven sample period: fast while any rail moves by more than
+// `delta_lsb` between two records or its running variance exceeds
+// `var_lsb2`, slow once every rail has been quiet for `hold_us`. Thresholds
+// are in raw LSBs so they apply to every backend alike.
+class RateControl {
+public:
+    explicit RateControl(const uint32_t &fast_us, const uint32_t &slow_us, const uint16_t &delta_lsb,
+                         const uint32_t &var_lsb2, const uint32_t &hold_us);
+
+    // Feed a record taken at `t`, returns the period until the next one
+    uint32_t update(const uint32_t &t, const int32_t *raw);
+    uint32_t period() const { return _fast ? _fast_us : _slow_us; }
+
+private:
+    uint32_t _fast_us;
+    uint32_t _slow_us;
+    uint16_t _delta_lsb;
+    uint32_t _var_lsb2;
+    uint32_t _hold_us;
+
+    bool _primed;
+    bool _fast;
+    uint32_t _last_active;
+    int32_t _prev[NUM_RAILS];
+    // Q8 running mean and running variance in LSB²
+    int32_t _mean[NUM_RAILS];
+    uint32_t _var[NUM_RAILS];
+};
+
+#endif // RATE_CONTROL_H
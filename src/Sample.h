@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "INA226.h"
+
+// Entries handed from the acquisition path to the transmit path. Trigger
+// edges travel in the same stream so they stay ordered with the data.
+typedef enum sample_kind {
+    SAMPLE_DATA,
+    SAMPLE_START,
+    SAMPLE_STOP
+} sample_kind_typeDef;
+
+typedef struct sample {
+    uint32_t t;                 // micros() at the start of the read
+#ifdef TIME64
+    uint64_t t_start_ns;        // DeviceClock around the sensor read
+    uint64_t t_end_ns;
+#endif
+    int32_t raw[NUM_RAILS];     // raw power per rail (INA226 current with SHUNT_ONLY), -1 on bus error
+    uint32_t period_us;         // time to the next record, 0 if fixed
+#ifdef EXT_CLOCK
+    uint8_t phase;              // sample index within the external clock period
+#endif
+#ifdef SHUNT_ONLY
+    int8_t vbus_rail;           // rail whose bus voltage follows the read, -1 if none
+    int32_t vbus_raw;           // raw bus voltage, -1 on error
+#endif
+    sample_kind_typeDef kind;
+} sample_typeDef;
+
+// Edge of a rail's ALERT line, captured in its pin interrupt
+typedef struct alert_event {
+    uint32_t t;
+    sensor_typeDef rail;
+    bool over;
+} alert_event_typeDef;
+
+#endif // SAMPLE_H
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring between exactly one producer and one consumer (thread or
+// ISR). N must be a power of two; indices run freely and wrap on uint16_t.
+template <typename T, uint16_t N>
+class SpscQueue {
+    static_assert(N != 0 && (N & (N - 1)) == 0, "SpscQueue length must be a power of two");
+
+public:
+    bool push(const T &item) {
+        uint16_t head = _head.load(std::memory_order_relaxed);
+        if ((uint16_t)(head - _tail.load(std::memory_order_acquire)) == N) return false;
+        _buf[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        uint16_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) return false;
+        item = _buf[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    T _buf[N];
+    std::atomic<uint16_t> _head{0};
+    std::atomic<uint16_t> _tail{0};
+};
+
+#endif // SPSC_QUEUE_H
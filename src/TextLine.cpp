@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TextLine.h"
+
+static const uint32_t dec_pow[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+void TextLine::put_char(const char &c) {
+    if (_len < TEXT_LINE_LEN - 2) _buf[_len++] = c;
+}
+
+void TextLine::put_u32(uint32_t val) {
+    char digits[10];
+    uint8_t n = 0;
+
+    do {
+        digits[n++] = '0' + (val % 10);
+        val /= 10;
+    } while (val != 0);
+
+    while (n > 0) put_char(digits[--n]);
+}
+
+void TextLine::put_u64(const uint64_t &val) {
+    if (val <= 0xffffffffULL) {
+        put_u32(val);
+        return;
+    }
+
+    // Peel off 9 digits at a time so only the split needs 64-bit division
+    put_u64(val / 1000000000ULL);
+    uint32_t low = val % 1000000000ULL;
+    for (uint32_t div = 100000000UL; div > 0; div /= 10) put_char('0' + (low / div) % 10);
+}
+
+void TextLine::put_micro(const int32_t &val, const uint8_t &decimals) {
+    uint32_t mag = (val < 0) ? -(uint32_t)val : (uint32_t)val;
+    uint32_t div = dec_pow[6 - decimals];
+    mag = (mag + div / 2) / div;
+
+    if (val < 0 && mag != 0) put_char('-');
+    put_u32(mag / dec_pow[decimals]);
+    if (decimals == 0) return;
+
+    put_char('.');
+    uint32_t frac = mag % dec_pow[decimals];
+    for (uint8_t i = decimals; i > 0; i--) put_char('0' + (frac / dec_pow[i - 1]) % 10);
+}
+
+size_t TextLine::send(Print *out) {
+    _buf[_len++] = '\r';
+    _buf[_len++] = '\n';
+    size_t n = out->write((const uint8_t *)_buf, _len);
+    _len = 0;
+    return n;
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TEXT_LINE_H
+#define TEXT_LINE_H
+
+#include "Arduino.h"
+
+// Room for 8 rails, two 64-bit timestamps and the period
+#define TEXT_LINE_LEN 192
+
+// Tab-separated record assembled with integer arithmetic only and sent with
+// a single write. Fixed-point values print exactly like Print::print(float, n)
+// so consumers of the text format see the same columns.
+class TextLine {
+public:
+    TextLine() : _len(0) {}
+
+    void clear() { _len = 0; }
+    void put_char(const char &c);
+    void put_u32(uint32_t val);
+    void put_u64(const uint64_t &val);
+    // val × 10⁻⁶ with `decimals` (0-6) digits after the point, rounded
+    void put_micro(const int32_t &val, const uint8_t &decimals);
+    // Terminate with CR LF, as println() does, and write the line
+    size_t send(Print *out);
+
+private:
+    char _buf[TEXT_LINE_LEN];
+    uint8_t _len;
+};
+
+#endif // TEXT_LINE_H
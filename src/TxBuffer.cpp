@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TxBuffer.h"
+
+TxBuffer::TxBuffer(Print *out)
+    : _out(out),
+      _len(0),
+      _first_us(0)
+{
+}
+
+size_t TxBuffer::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t TxBuffer::write(const uint8_t *buf, size_t len) {
+    size_t left = len;
+
+    while (left > 0) {
+        if (_len == 0) _first_us = micros();
+
+        size_t chunk = min(left, sizeof(_buf) - _len);
+        memcpy(&_buf[_len], buf, chunk);
+        _len += chunk;
+        buf += chunk;
+        left -= chunk;
+
+        if (_len == sizeof(_buf)) flush();
+    }
+    return len;
+}
+
+void TxBuffer::flush() {
+    if (_len == 0) return;
+    _out->write(_buf, _len);
+    _len = 0;
+}
+
+void TxBuffer::poll() {
+    if (_len != 0 && (uint32_t)(micros() - _first_us) >= TX_FLUSH_US) flush();
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TX_BUFFER_H
+#define TX_BUFFER_H
+
+#include "Arduino.h"
+
+// Full-speed USB bulk endpoint size
+#define TX_PACKET_LEN 64
+// Packets assembled per Serial.write
+#ifndef TX_PACKETS
+  #define TX_PACKETS 4
+#endif
+// Maximum time a byte may wait in the buffer
+#ifndef TX_FLUSH_US
+  #define TX_FLUSH_US 2000
+#endif
+
+// Print sink that batches output into whole USB packets, so each sample no
+// longer turns into several short CDC transfers. Anything still buffered is
+// handed over by poll() once it is TX_FLUSH_US old.
+class TxBuffer : public Print {
+public:
+    explicit TxBuffer(Print *out = &Serial);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buf, size_t len) override;
+    using Print::write;
+
+    void flush() override;
+    void poll();
+
+private:
+    Print * _out;
+    uint8_t _buf[TX_PACKET_LEN * TX_PACKETS];
+    size_t _len;
+    uint32_t _first_us;
+};
+
+#endif // TX_BUFFER_H
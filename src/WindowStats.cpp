@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "WindowStats.h"
+
+void RunningStat::reset() {
+    n = 0;
+    mean = 0;
+    m2 = 0;
+    min = 0;
+    max = 0;
+}
+
+void RunningStat::add(const double &x) {
+    n++;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+    if (n == 1 || x < min) min = x;
+    if (n == 1 || x > max) max = x;
+}
+
+WindowStats::WindowStats() : _open(false) {
+    reset();
+}
+
+void WindowStats::reset() {
+    _dur.reset();
+    _total.reset();
+    for (int i = 0; i < NUM_RAILS; i++) _energy[i].reset();
+    _skipped = 0;
+}
+
+void WindowStats::open(const uint32_t &t) {
+    _open = true;
+    _t_open = t;
+    _t_prev = t;
+    for (int i = 0; i < NUM_RAILS; i++) {
+        _prev[i] = -1;
+        _acc[i] = 0;
+    }
+}
+
+void WindowStats::add(const uint32_t &t, const int32_t *raw) {
+    if (!_open) return;
+
+    // Records stamped before the edge count from the edge
+    uint32_t dt = (int32_t)(t - _t_prev) > 0 ? t - _t_prev : 0;
+    uint32_t since = (int32_t)(t - _t_open) > 0 ? t - _t_open : 0;
+    for (int i = 0; i < NUM_RAILS; i++) {
+        if (raw[i] < 0) continue;
+        // The first reading of a rail also covers the time since the start
+        if (_prev[i] < 0) _acc[i] += (uint64_t)raw[i] * since;
+        else _acc[i] += (uint64_t)_prev[i] * dt;
+        _prev[i] = raw[i];
+    }
+    if (dt) _t_prev = t;
+}
+
+void WindowStats::close(const uint32_t &t, const uint32_t *lsb_uw) {
+    if (!_open) return;
+    _open = false;
+
+    // A rail without a single reading has no energy for this window, which
+    // is left out of every quantity so they all cover the same windows
+    for (int i = 0; i < NUM_RAILS; i++) {
+        if (_prev[i] < 0) {
+            _skipped++;
+            return;
+        }
+    }
+
+    uint32_t dt = (int32_t)(t - _t_prev) > 0 ? t - _t_prev : 0;
+    double total = 0;
+    for (int i = 0; i < NUM_RAILS; i++) {
+        _acc[i] += (uint64_t)_prev[i] * dt;
+        double joules = (double)_acc[i] * lsb_uw[i] * 1e-12;
+        _energy[i].add(joules);
+        total += joules;
+    }
+    _total.add(total);
+    _dur.add((uint32_t)(t - _t_open) * 1e-6);
+}
+
+// x as <mantissa>e<exponent>, Print::print(double) overflows above 2^32
+void WindowStats::_print_sci(Print *out, const double &x) {
+    if (x == 0) {
+        out->print('0');
+        return;
+    }
+    int exp = (int)floor(log10(fabs(x)));
+    double mant = x / pow(10, exp);
+    // Rounding to 6 decimals may carry into the next digit
+    if (fabs(mant) >= 9.9999995) {
+        mant /= 10;
+        exp++;
+    }
+    out->print(mant, 6);
+    out->print('e');
+    out->print(exp);
+}
+
+void WindowStats::_print_stat(Print *out, const uint32_t &t, const RunningStat &s) {
+    out->print(t);
+    out->print('\t');
+    out->print(s.n);
+    out->print('\t');
+    _print_sci(out, s.mean);
+    out->print('\t');
+    _print_sci(out, s.m2);
+    out->print('\t');
+    _print_sci(out, s.min);
+    out->print('\t');
+    _print_sci(out, s.max);
+    out->println();
+}
+
+void WindowStats::emit(Print *out, const uint32_t &t) {
+    if (empty()) return;
+
+    if (_dur.n) {
+        out->print(F("#WSTAT\t"));
+        out->print(F("dur\t"));
+        _print_stat(out, t, _dur);
+        for (int i = 0; i < NUM_RAILS; i++) {
+            out->print(F("#WSTAT\t"));
+            out->print(i);
+            out->print('\t');
+            _print_stat(out, t, _energy[i]);
+        }
+        out->print(F("#WSTAT\tall\t"));
+        _print_stat(out, t, _total);
+    }
+    if (_skipped) {
+        out->print(F("#WSTAT\tskipped\t"));
+        out->print(t);
+        out->print('\t');
+        out->print(_skipped);
+        out->println(F("\t0\t0\t0\t0"));
+    }
+    reset();
+}
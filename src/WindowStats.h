@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Copyright © 2025 Christian Conti, Alessandro Varaldi
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the Licence, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+
+#include "INA226.h"
+
+// Running count, mean, sum of squared deviations (Welford), min and max
+struct RunningStat {
+    uint32_t n;
+    double mean;
+    double m2;
+    double min;
+    double max;
+
+    void reset();
+    void add(const double &x);
+};
+
+// Per-invocation energy of repeated trigger windows. Records are integrated
+// on the device (each one holding until the next, the first from the window
+// start and the last to its end), every closed window adds its duration and
+// per-rail energy to the running statistics, and only those are sent:
+//
+//   #WSTAT <quantity> <t> <count> <mean> <m2> <min> <max>
+//
+// one line per quantity: `dur` in seconds, the rail index or `all` (sum of
+// the rails) in joules. Each line covers the windows closed since the
+// previous one, so the host merges them with the parallel variance formula.
+// A window in which some rail got no reading adds to none of them; those
+// are only counted, as `skipped` with zero statistics.
+class WindowStats {
+public:
+    WindowStats();
+
+    void open(const uint32_t &t);
+    void add(const uint32_t &t, const int32_t *raw);
+    void close(const uint32_t &t, const uint32_t *lsb_uw);
+    bool empty() const { return _dur.n == 0 && _skipped == 0; }
+    // Send the statistics at device time `t` and start over
+    void emit(Print *out, const uint32_t &t);
+    void reset();
+
+private:
+    bool _open;
+    uint32_t _t_open;
+    uint32_t _t_prev;
+    int32_t _prev[NUM_RAILS];       // last valid reading, -1 before the first
+    uint64_t _acc[NUM_RAILS];       // raw × µs over the window
+    RunningStat _dur;
+    RunningStat _energy[NUM_RAILS];
+    RunningStat _total;
+    uint32_t _skipped;
+
+    static void _print_sci(Print *out, const double &x);
+    static void _print_stat(Print *out, const uint32_t &t, const RunningStat &s);
+};
+
+#endif // WINDOW_STATS_H
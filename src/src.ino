@@ -17,67 +17,1298 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "INA226.h"
+#include "TxBuffer.h"
+#include "Sample.h"
 
-float pwr_ps = 0;
-float pwr_pl = 0;
+#ifdef FILTER
+  #include "RailFilter.h"
+
+  #ifndef DECIMATE
+    #define DECIMATE 1
+  #endif
+  #if DECIMATE < 1 || DECIMATE > 65535
+    #error "DECIMATE must be 1 to 65535 samples per record"
+  #endif
+#endif
+
+#ifdef DEADBAND
+  #include "Deadband.h"
+
+  #ifndef DEADBAND_LSB
+    #define DEADBAND_LSB 4
+  #endif
+  #ifndef HEARTBEAT_MS
+    #define HEARTBEAT_MS 1000
+  #endif
+#endif
+
+#ifdef COMPRESS
+  #include "DeltaCoder.h"
+
+  #ifdef DEADBAND
+    #error "COMPRESS already removes the redundancy DEADBAND targets, enable only one"
+  #endif
+#endif
+
+#ifdef HISTOGRAM
+  #include "PowerHist.h"
+
+  #if defined(COMPRESS) || defined(DEADBAND)
+    #error "HISTOGRAM sends no per-sample records, COMPRESS/DEADBAND do not apply"
+  #endif
+  // Window length when windows are not delimited by the external trigger
+  #ifndef HIST_WINDOW_MS
+    #define HIST_WINDOW_MS 1000
+  #endif
+#endif
+
+#ifdef POWER_ALERT
+  #include "SpscQueue.h"
+
+  // INA226 ALERT outputs (open-drain, active low), one pin per rail
+  #ifndef ALERT_PIN_PS
+    #define ALERT_PIN_PS 3
+  #endif
+  #ifndef ALERT_PIN_PL
+    #define ALERT_PIN_PL 4
+  #endif
+  // Power limits in watts, 0 leaves the rail unmonitored
+  #ifndef PWR_LIMIT_PS_W
+    #define PWR_LIMIT_PS_W 0
+  #endif
+  #ifndef PWR_LIMIT_PL_W
+    #define PWR_LIMIT_PL_W 0
+  #endif
+  // Define THROTTLE_PIN to drive it HIGH while any rail is over its limit
+  #define ALERT_QUEUE_LEN 16
+#endif
+
+#if PMBUS_RAILS > 0
+  #include "PMBus.h"
+
+  #if PMBUS_RAILS > PMBUS_MAX_RAILS
+    #error "Too many PMBus rails"
+  #endif
+  // Each PMBUS_RAILn is (address << 8) | page; define PMBUS_PEC to check
+  // and send packet error codes
+  #ifdef PMBUS_PEC
+    #define PMBUS_USE_PEC true
+  #else
+    #define PMBUS_USE_PEC false
+  #endif
+#endif
+
+#ifdef AUTO_RAILS
+  #include "FlashStore.h"
+
+  // The rail table found by the last scan is kept in this flash slot
+  #define RAIL_STORE_SLOT 0
+  #define HOST_COMMANDS
+#endif
+
+#ifdef PROFILES
+  #include "Profile.h"
+
+  #define HOST_COMMANDS
+  #define LOOP_PACING
+#endif
+
+#ifdef ADAPTIVE_RATE
+  #include "RateControl.h"
+
+  #if defined(COMPRESS) || defined(HISTOGRAM) || defined(FILTER) || defined(DEADBAND)
+    #error "ADAPTIVE_RATE tags every text record with its period, COMPRESS/HISTOGRAM/FILTER/DEADBAND assume a fixed rate"
+  #endif
+  // Periods while the rails move and while they are steady
+  #ifndef ADAPT_FAST_US
+    #define ADAPT_FAST_US 250
+  #endif
+  #ifndef ADAPT_SLOW_US
+    #define ADAPT_SLOW_US 10000
+  #endif
+  // Activity: a step above ADAPT_DELTA_LSB or a running variance above
+  // ADAPT_VAR_LSB2 on any rail; the fast rate is kept ADAPT_HOLD_MS after it
+  #ifndef ADAPT_DELTA_LSB
+    #define ADAPT_DELTA_LSB 8
+  #endif
+  #ifndef ADAPT_VAR_LSB2
+    #define ADAPT_VAR_LSB2 64
+  #endif
+  #ifndef ADAPT_HOLD_MS
+    #define ADAPT_HOLD_MS 100
+  #endif
+  #define LOOP_PACING
+#endif
+
+#ifdef TIME64
+  #include "DeviceClock.h"
+
+  #if defined(COMPRESS) || defined(HISTOGRAM)
+    #error "TIME64 stamps text records, COMPRESS/HISTOGRAM keep their own 32-bit time fields"
+  #endif
+#endif
+
+#ifdef SHUNT_ONLY
+  #if defined(HISTOGRAM) || defined(POWER_ALERT) || defined(PROFILES)
+    #error "SHUNT_ONLY sends currents for the host to turn into power, HISTOGRAM/POWER_ALERT/PROFILES need power on the device"
+  #endif
+  #ifndef VBUS_EVERY_MS
+    #define VBUS_EVERY_MS 100
+  #endif
+#endif
+
+#ifdef EXT_CLOCK
+  #if defined(RTOS_ACQ) || defined(ADAPTIVE_RATE)
+    #error "EXT_CLOCK paces the loop from the clock input, RTOS_ACQ/ADAPTIVE_RATE pace it themselves"
+  #endif
+  #ifndef EXT_CLOCK_PIN
+    #define EXT_CLOCK_PIN 5
+  #endif
+  // Samples per clock period, the first one on the edge
+  #ifndef EXT_CLOCK_DIV
+    #define EXT_CLOCK_DIV 1
+  #endif
+  #if EXT_CLOCK_DIV > 1 && (defined(COMPRESS) || defined(FILTER))
+    #error "EXT_CLOCK_DIV > 1 tags text records with their phase, COMPRESS/FILTER do not carry it"
+  #endif
+#endif
+
+#ifdef EXT_TRIGGER
+  // Debouncing of the trigger line: a rise opens a window once the line
+  // stayed high TRIG_MIN_US, a fall closes it once it stayed low
+  // TRIG_COALESCE_US. 0 reacts to every edge.
+  #ifndef TRIG_MIN_US
+    #define TRIG_MIN_US 0
+  #endif
+  #ifndef TRIG_COALESCE_US
+    #define TRIG_COALESCE_US 0
+  #endif
+#endif
+
+#ifdef TRIG_BATCH
+  #ifndef EXT_TRIGGER
+    #error "TRIG_BATCH requires EXT_TRIGGER"
+  #endif
+  #ifdef HISTOGRAM
+    #error "HISTOGRAM sends no records or markers, TRIG_BATCH does not apply"
+  #endif
+  #if TRIG_BATCH < 1 || TRIG_BATCH > 16
+    #error "TRIG_BATCH must be 1 to 16 windows per line"
+  #endif
+  // Longest a closed window waits for the rest of its batch
+  #ifndef TRIG_BATCH_FLUSH_MS
+    #define TRIG_BATCH_FLUSH_MS 100
+  #endif
+#endif
+
+#ifdef WINDOW_STATS
+  #include "WindowStats.h"
+
+  #ifndef EXT_TRIGGER
+    #error "WINDOW_STATS aggregates trigger windows, it requires EXT_TRIGGER"
+  #endif
+  #if defined(HISTOGRAM) || defined(COMPRESS) || defined(DEADBAND) || defined(TRIG_BATCH) || defined(SHUNT_ONLY)
+    #error "WINDOW_STATS sends no records or markers and needs power on the device, HISTOGRAM/COMPRESS/DEADBAND/TRIG_BATCH/SHUNT_ONLY do not apply"
+  #endif
+  // Interval between the statistics lines
+  #ifndef WSTAT_EVERY_MS
+    #define WSTAT_EVERY_MS 1000
+  #endif
+#endif
+
+#ifdef SYNC_PULSE
+  // Shared sync line between loggers, driven by the one built with
+  // SYNC_MASTER (or by external hardware)
+  #ifndef SYNC_PIN
+    #define SYNC_PIN 6
+  #endif
+  #ifndef SYNC_PERIOD_MS
+    #define SYNC_PERIOD_MS 1000
+  #endif
+  #ifndef SYNC_WIDTH_US
+    #define SYNC_WIDTH_US 100
+  #endif
+#endif
+
+#ifdef FIXED_TEXT
+  #include "TextLine.h"
+
+  #ifndef TEXT_DECIMALS
+    #define TEXT_DECIMALS 5
+  #endif
+#endif
+
+#ifdef RTOS_ACQ
+  #include "AcqThread.h"
+  #include "SpscQueue.h"
+
+  #ifndef ACQ_THREAD_AVAILABLE
+    #error "RTOS_ACQ requires an mbed OS core"
+  #endif
+  #ifndef SAMPLE_PERIOD_US
+    #define SAMPLE_PERIOD_US 1000
+  #endif
+  #define SAMPLE_QUEUE_LEN 64
+#endif
+
+// Raw power is scaled to watts only when printed (INA226 currents to amps
+// with SHUNT_ONLY), by raw_lsb × LSB_SCALE. The INA226 current LSBs are not
+// whole µA, so shunt-only builds keep every LSB in nano units.
+uint32_t raw_lsb[NUM_RAILS] = {0};
+#ifdef SHUNT_ONLY
+  #define LSB_SCALE 1e-9f
+#else
+  #define LSB_SCALE 1e-6f
+#endif
+
+// Raw value in micro units, for the fixed-point printer
+inline int32_t raw_micro(const int32_t &raw, const uint32_t &lsb) {
+#ifdef SHUNT_ONLY
+  return (int32_t)(((int64_t)raw * lsb + 500) / 1000);
+#else
+  return raw * (int32_t)lsb;
+#endif
+}
+
+#ifdef LOOP_PACING
+  // Sample period of the free-running loop, 0 = unpaced, the start of the
+  // next paced record and the whole periods the loop fell behind by
+  uint32_t period_us = 0;
+  uint32_t next_t = 0;
+  uint32_t pace_missed = 0;
+#endif
+
+// All output goes through here and reaches Serial in whole USB packets
+TxBuffer tx;
+
+#ifdef TIME64
+  DeviceClock clock64;
+#endif
 
 INA226 *ina;
+// Monitor used for the PL rail: a second instance on Wire1 in DUAL_BUS mode,
+// the same instance as the PS rail otherwise
+INA226 *ina_pl;
+
+// Backend and channel behind each record column
+PowerSensor *rail_sensor[NUM_RAILS];
+uint8_t rail_channel[NUM_RAILS];
+
+#if PMBUS_RAILS > 0
+  PMBus *pmbus;
+  static const uint16_t pmbus_rails[PMBUS_RAILS] = {
+    PMBUS_RAIL0,
+  #if PMBUS_RAILS > 1
+    PMBUS_RAIL1,
+  #endif
+  #if PMBUS_RAILS > 2
+    PMBUS_RAIL2,
+  #endif
+  #if PMBUS_RAILS > 3
+    PMBUS_RAIL3,
+  #endif
+  #if PMBUS_RAILS > 4
+    PMBUS_RAIL4,
+  #endif
+  #if PMBUS_RAILS > 5
+    PMBUS_RAIL5,
+  #endif
+  };
+#endif
+
+#if defined(BOARD_ZCU106)
+  #define TARGET_BOARD ZCU106
+#elif defined(BOARD_ZCU102)
+  #define TARGET_BOARD ZCU102
+#endif
+
+#if defined(AUTO_RAILS) && !defined(TARGET_BOARD)
+  #error "AUTO_RAILS requires BOARD_ZCU102 or BOARD_ZCU106"
+#endif
+
+#if defined(PROFILES) && !defined(TARGET_BOARD)
+  #error "PROFILES requires BOARD_ZCU102 or BOARD_ZCU106"
+#endif
+
+#if defined(SHUNT_ONLY) && !defined(TARGET_BOARD)
+  #error "SHUNT_ONLY requires BOARD_ZCU102 or BOARD_ZCU106"
+#endif
+
+#if defined(DUAL_BUS) && (WIRE_HOWMANY < 2)
+  #error "DUAL_BUS requires a board with a second TWI (Wire1)"
+#endif
 
 #ifdef EXT_TRIGGER
   constexpr uint8_t TRIGGER_PIN = 2;          // interrupt capable pin
-  volatile bool logging = false;        
-  volatile bool interrupt  = false;     
+  volatile bool logging = false;              // raw line level
+  // Last edge, in µs for the debouncing and on the records' time base
+  volatile uint32_t trigger_edge_t = 0;
+#ifdef TIME64
+  volatile uint64_t trigger_edge_ns = 0;
+#endif
+  // Debounced state, owned by the context that reads the sensors
+  bool window_open = false;
 #endif
 
 #ifdef EXT_TRIGGER
   void triggerISR() {
     logging = digitalRead(TRIGGER_PIN);
-    interrupt = true;                  
+    trigger_edge_t = micros();
+#ifdef TIME64
+    trigger_edge_ns = clock64.now_ns();
+#endif
+  }
+
+  // Whether the debounced trigger changed state; `mark` then gets the
+  // marker, stamped with the edge that opened or closed the window
+  bool trigger_changed(sample_typeDef &mark) {
+    noInterrupts();
+    bool level = logging;
+    uint32_t edge = trigger_edge_t;
+#ifdef TIME64
+    uint64_t edge_ns = trigger_edge_ns;
+#endif
+    interrupts();
+
+    if (level == window_open) return false;
+    if ((uint32_t)(micros() - edge) < (level ? TRIG_MIN_US : TRIG_COALESCE_US)) return false;
+    window_open = level;
+    mark.kind = level ? SAMPLE_START : SAMPLE_STOP;
+    mark.t = edge;
+#ifdef TIME64
+    mark.t_start_ns = edge_ns;
+#endif
+    return true;
+  }
+#endif
+
+#ifdef EXT_CLOCK
+  volatile uint32_t clock_edges = 0;
+  volatile uint32_t clock_edge_t = 0;
+  // Phase of the record being read, 0 .. EXT_CLOCK_DIV - 1
+  uint8_t clock_phase = 0;
+  // Samples the loop was too slow to take
+  uint32_t clock_missed = 0;
+
+  void clockISR() {
+    clock_edge_t = micros();
+    clock_edges++;
+  }
+
+  // Whether a sample is due: the k-th one of each clock period falls at
+  // edge + k * period / EXT_CLOCK_DIV, the period being measured between
+  // edges. Every edge re-phases the schedule, so the samples stay locked
+  // to the clock however far the internal oscillator drifts.
+  bool clock_due() {
+    static uint32_t seen = 0;
+    static uint32_t edge = 0;
+    static uint32_t period = 0;
+    static uint8_t k = EXT_CLOCK_DIV;
+
+    noInterrupts();
+    uint32_t n = clock_edges;
+    uint32_t t = clock_edge_t;
+    interrupts();
+
+    if (n != seen) {
+      // Samples left over from the last period and whole periods skipped
+      if (seen != 0) {
+        if (period != 0) clock_missed += (EXT_CLOCK_DIV - k) + (n - seen - 1) * EXT_CLOCK_DIV;
+        period = (t - edge) / (n - seen);
+      }
+      seen = n;
+      edge = t;
+      k = 0;
+    }
+
+    if (k >= EXT_CLOCK_DIV) return false;
+    if (k > 0) {
+      if (period == 0) return false;
+      uint32_t at = edge + (uint32_t)((uint64_t)k * period / EXT_CLOCK_DIV);
+      if ((int32_t)(micros() - at) < 0) return false;
+    }
+    clock_phase = k++;
+    return true;
+  }
+#endif
+
+#ifdef POWER_ALERT
+  // Pin interrupts timestamp the edges and drive the throttle output right
+  // away; loop() turns them into #ALERT events
+  SpscQueue<alert_event_typeDef, ALERT_QUEUE_LEN> alerts;
+  volatile uint8_t alert_state = 0;
+  volatile uint32_t alerts_lost = 0;
+
+  void alert_edge(const sensor_typeDef &rail, const uint8_t &pin) {
+    alert_event_typeDef e;
+    e.t = micros();
+    e.rail = rail;
+    e.over = (digitalRead(pin) == LOW);
+
+    alert_state = e.over ? (alert_state | (1 << rail)) : (alert_state & ~(1 << rail));
+#ifdef THROTTLE_PIN
+    digitalWrite(THROTTLE_PIN, alert_state ? HIGH : LOW);
+#endif
+    if (!alerts.push(e)) alerts_lost++;
+  }
+
+  void alertISR_PS() { alert_edge(PS, ALERT_PIN_PS); }
+  void alertISR_PL() { alert_edge(PL, ALERT_PIN_PL); }
+#endif
+
+#ifdef AUTO_RAILS
+  FlashStore rail_store(RAIL_STORE_SLOT);
+  // Changes with the layout of the stored table; the board keeps ZCU102 and
+  // ZCU106 tables apart
+  #define RAIL_MAGIC (0x5241494CUL + TARGET_BOARD)
+
+  // Point each rail at the monitor found on the bus. The table comes from
+  // flash unless `force` is set or nothing valid is stored; it is only
+  // stored once every rail was found, rails left unfound keep their
+  // default location.
+  void discover_rails(const bool &force) {
+    rail_loc_typeDef rails[NUM_SENS];
+
+    if (force || !rail_store.load(rails, sizeof(rails), RAIL_MAGIC)) {
+      rail_loc_typeDef found[NUM_SENS];
+      uint8_t n = 0;
+      rails[PS] = ina->get_rail(PS);
+      rails[PL] = ina_pl->get_rail(PL);
+#ifdef DUAL_BUS
+      // One monitor per bus
+      if (ina->scan(found, 1)) { rails[PS] = found[0]; n++; }
+      if (ina_pl->scan(found, 1)) { rails[PL] = found[0]; n++; }
+#else
+      // The first monitor on each mux channel, in channel order, which is
+      // also the default rail order
+      n = ina->scan(found, NUM_SENS);
+      for (uint8_t i = 0; i < n; i++) rails[i] = found[i];
+#endif
+      if (n == NUM_SENS) rail_store.save(rails, sizeof(rails), RAIL_MAGIC);
+    }
+
+    ina->set_rail(PS, rails[PS]);
+    ina_pl->set_rail(PL, rails[PL]);
+    ina->calibrate();
+    if (ina_pl != ina) ina_pl->calibrate();
+
+    for (int i = 0; i < NUM_SENS; i++) {
+      tx.print(F("#RAIL\t"));
+      tx.print(i);
+      tx.print('\t');
+      tx.print(rails[i].mux);
+      tx.print('\t');
+      tx.println(rails[i].addr);
+    }
+  }
+#endif
+
+// Blocking readout of rails `first` to NUM_RAILS - 1
+void read_rails_from(int32_t *raw, const uint8_t &first) {
+  for (uint8_t i = first; i < NUM_RAILS; i++) raw[i] = rail_sensor[i]->read_raw(rail_channel[i]);
+}
+
+// Blocking readout of every rail
+void read_rails(int32_t *raw) {
+#ifdef ASYNC_I2C
+  ina->request_pwr(PS);
+  ina_pl->request_pwr(PL);
+  while (!ina->pwr_ready(PS) || !ina_pl->pwr_ready(PL)) {}
+  raw[PS] = ina->take_pwr_raw(PS);
+  raw[PL] = ina_pl->take_pwr_raw(PL);
+  // The other backends run once the queued transfers are done
+  read_rails_from(raw, NUM_SENS);
+#else
+  read_rails_from(raw, 0);
+#endif
+}
+
+#ifdef RTOS_ACQ
+  // Acquisition runs in a realtime thread at a fixed period and hands records
+  // to loop(), which only transmits, so USB servicing no longer shifts samples
+  SpscQueue<sample_typeDef, SAMPLE_QUEUE_LEN> samples;
+  std::atomic<uint32_t> dropped{0};
+  AcqThread *acq;
+#endif
+
+#ifdef ADAPTIVE_RATE
+  RateControl rate(ADAPT_FAST_US, ADAPT_SLOW_US, ADAPT_DELTA_LSB, ADAPT_VAR_LSB2, ADAPT_HOLD_MS * 1000UL);
+#endif
+
+#ifdef SHUNT_ONLY
+  // Bus voltages are sampled one INA226 rail at a time, round robin
+  uint32_t vbus_t = 0;
+  uint8_t vbus_next = 0;
+#endif
+
+// Attach a bus voltage to the record when one is due. Runs after the end
+// stamp: the conversion stalls the bus for a few hundred µs, which belongs
+// to no record.
+void sample_vbus(sample_typeDef &s) {
+#ifdef SHUNT_ONLY
+  s.vbus_rail = -1;
+  if ((uint32_t)(s.t - vbus_t) < VBUS_EVERY_MS * 1000UL) return;
+  vbus_t = s.t;
+  INA226 *mon = (vbus_next == PS) ? ina : ina_pl;
+  s.vbus_rail = vbus_next;
+  s.vbus_raw = mon->get_bus_raw((sensor_typeDef)vbus_next);
+  vbus_next = (vbus_next + 1) % NUM_SENS;
+#else
+  (void)s;
+#endif
+}
+
+// Pick the period following the record read at `t` and put it in force;
+// 0 when the rate is fixed
+uint32_t next_period(const uint32_t &t, const int32_t *raw) {
+#ifdef ADAPTIVE_RATE
+  uint32_t p = rate.update(t, raw);
+#ifdef RTOS_ACQ
+  static uint32_t p_set = ADAPT_SLOW_US;
+  if (p != p_set) {
+    acq->set_period(p);
+    p_set = p;
+  }
+#else
+  period_us = p;
+#endif
+  return p;
+#else
+  (void)t;
+  (void)raw;
+  return 0;
+#endif
+}
+
+// Stamp the start of a record, right before its first bus transfer
+void stamp_start(sample_typeDef &s) {
+  s.kind = SAMPLE_DATA;
+#ifdef EXT_CLOCK
+  s.phase = clock_phase;
+#endif
+#ifdef TIME64
+  s.t_start_ns = clock64.now_ns();
+#endif
+  s.t = micros();
+}
+
+// Stamp the end of the read and pick the period that follows it
+void stamp_end(sample_typeDef &s) {
+#ifdef TIME64
+  s.t_end_ns = clock64.now_ns();
+#endif
+  s.period_us = next_period(s.t, s.raw);
+#ifdef LOOP_PACING
+  // Scheduled with the period the record reports, not the one before it
+  next_t += period_us;
+#endif
+  sample_vbus(s);
+}
+
+// Blocking read of a whole record
+void read_sample(sample_typeDef &s) {
+  stamp_start(s);
+  read_rails(s.raw);
+  stamp_end(s);
+}
+
+#ifdef RTOS_ACQ
+  void acquire() {
+    sample_typeDef s;
+#ifdef EXT_TRIGGER
+    // Trigger edges are queued as markers so they stay ordered with the data;
+    // a marker that does not fit is retried on the next period
+    static sample_typeDef mark;
+    static bool mark_pending = false;
+    if (!mark_pending) mark_pending = trigger_changed(mark);
+    if (mark_pending) {
+      if (samples.push(mark)) mark_pending = false;
+      else dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!window_open || mark_pending) return;
+#endif
+    read_sample(s);
+    if (!samples.push(s)) dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+#endif
+
+#ifdef FIXED_TEXT
+  TextLine line;
+#endif
+
+#ifdef FILTER
+  RailFilter rail_filter(DECIMATE);
+#endif
+
+#ifdef DEADBAND
+  Deadband deadband(DEADBAND_LSB, HEARTBEAT_MS * 1000UL);
+#endif
+
+#ifdef COMPRESS
+  DeltaCoder coder(raw_lsb);
+#endif
+
+#ifdef HISTOGRAM
+  PowerHist hist;
+#endif
+
+#ifdef WINDOW_STATS
+  WindowStats wstats;
+#endif
+
+#define ALL_RAILS ((1 << NUM_RAILS) - 1)
+
+// Prints `raw` (the record's values after filtering) with the time of `s`.
+// Rails not set in `mask` are left as empty fields; with TIME64 the read
+// start and end in ns replace the µs time, with ADAPTIVE_RATE the period to
+// the next record and with EXT_CLOCK_DIV > 1 the phase in the clock period
+// close the line.
+void print_sample(const sample_typeDef &s, const int32_t *raw, const uint8_t &mask) {
+#ifdef FIXED_TEXT
+  // Same columns as the float printer, integer arithmetic only
+#ifdef TIME64
+  line.put_u64(s.t_start_ns);
+  line.put_char('\t');
+  line.put_u64(s.t_end_ns);
+#else
+  line.put_u32(s.t);
+#endif
+  for (int i = 0; i < NUM_RAILS; i++) {
+    line.put_char('\t');
+    if (mask & (1 << i)) line.put_micro(raw_micro(raw[i], raw_lsb[i]), TEXT_DECIMALS);
+  }
+#ifdef ADAPTIVE_RATE
+  line.put_char('\t');
+  line.put_u32(s.period_us);
+#endif
+#if defined(EXT_CLOCK) && EXT_CLOCK_DIV > 1
+  line.put_char('\t');
+  line.put_u32(s.phase);
+#endif
+  line.send(&tx);
+#else
+#ifdef TIME64
+  tx.print(s.t_start_ns);
+  tx.print('\t');
+  tx.print(s.t_end_ns);
+#else
+  tx.print(s.t);
+#endif
+  for (int i = 0; i < NUM_RAILS; i++) {
+    tx.print('\t');
+    if (mask & (1 << i)) tx.print((float)raw[i] * raw_lsb[i] * LSB_SCALE, 5);
+  }
+#ifdef ADAPTIVE_RATE
+  tx.print('\t');
+  tx.print(s.period_us);
+#endif
+#if defined(EXT_CLOCK) && EXT_CLOCK_DIV > 1
+  tx.print('\t');
+  tx.print(s.phase);
+#endif
+  tx.println();
+#endif
+}
+
+// Data records pass through here on their way to the encoder
+void emit_sample(const sample_typeDef &s) {
+  const int32_t *raw = s.raw;
+#ifdef SHUNT_ONLY
+  // #VBUS <t> <rail> <µV>, on the same time base as the records
+  if (s.vbus_rail >= 0) {
+    tx.print(F("#VBUS\t"));
+#ifdef TIME64
+    tx.print(s.t_start_ns);
+#else
+    tx.print(s.t);
+#endif
+    tx.print('\t');
+    tx.print(s.vbus_rail);
+    tx.print('\t');
+    tx.println(s.vbus_raw < 0 ? -1L : (long)s.vbus_raw * BUS_LSB_UV);
+  }
+#endif
+#ifdef FILTER
+  int32_t filtered[NUM_RAILS];
+  if (!rail_filter.push(raw, filtered)) return;
+  raw = filtered;
+#endif
+#if defined(WINDOW_STATS)
+  // Only the per-window statistics leave the device
+  wstats.add(s.t, raw);
+#elif defined(HISTOGRAM)
+  // Only the distribution of each window leaves the device
+  hist.add(s.t, raw);
+#ifndef EXT_TRIGGER
+  if ((uint32_t)(s.t - hist.t_start()) >= HIST_WINDOW_MS * 1000UL) hist.emit(&tx, raw_lsb);
+#endif
+#elif defined(COMPRESS)
+  coder.push(s.t, raw, &tx);
+#elif defined(DEADBAND)
+  uint8_t mask;
+  if (deadband.update(s.t, raw, mask)) print_sample(s, raw, mask);
+#else
+  print_sample(s, raw, ALL_RAILS);
+#endif
+}
+
+#ifdef SYNC_PULSE
+  volatile uint32_t sync_count = 0;
+#ifdef TIME64
+  volatile uint64_t sync_t = 0;
+#else
+  volatile uint32_t sync_t = 0;
+#endif
+
+  // Device time of now, on the time base of the records
+  void sync_edge() {
+#ifdef TIME64
+    sync_t = clock64.now_ns();
+#else
+    sync_t = micros();
+#endif
+    sync_count++;
+  }
+
+#ifdef SYNC_MASTER
+  // Driven from loop(): when the edge happens does not matter, only that
+  // its timestamp is taken right at the pin write
+  void drive_sync() {
+    static uint32_t rise_t = 0;
+    static bool high = false;
+    uint32_t now = micros();
+
+    if (high && (uint32_t)(now - rise_t) >= SYNC_WIDTH_US) {
+      digitalWrite(SYNC_PIN, LOW);
+      high = false;
+    } else if (!high && (uint32_t)(now - rise_t) >= SYNC_PERIOD_MS * 1000UL) {
+      noInterrupts();
+      digitalWrite(SYNC_PIN, HIGH);
+      sync_edge();
+      interrupts();
+      rise_t = now;
+      high = true;
+    }
+  }
+#endif
+#endif
+
+// #SYNC <n> <t>: the n-th edge of the sync line, at device time t
+void emit_sync() {
+#ifdef SYNC_PULSE
+#ifdef SYNC_MASTER
+  drive_sync();
+#endif
+  static uint32_t reported = 0;
+  noInterrupts();
+  uint32_t n = sync_count;
+#ifdef TIME64
+  uint64_t t = sync_t;
+#else
+  uint32_t t = sync_t;
+#endif
+  interrupts();
+  if (n == reported) return;
+  reported = n;
+  tx.print(F("#SYNC\t"));
+  tx.print(n);
+  tx.print('\t');
+  tx.println(t);
+#endif
+}
+
+void emit_alerts() {
+#ifdef POWER_ALERT
+  alert_event_typeDef e;
+  while (alerts.pop(e)) {
+    tx.print(F("#ALERT\t"));
+    tx.print(e.t);
+    tx.print('\t');
+    tx.print(e.rail);
+    tx.print('\t');
+    tx.println(e.over ? 1 : 0);
+  }
+
+  // Edges that found the queue full, like #DROP a running total
+  static uint32_t lost_reported = 0;
+  uint32_t lost = alerts_lost;
+  if (lost != lost_reported) {
+    tx.print(F("#ALERTLOST\t"));
+    tx.println(lost);
+    lost_reported = lost;
+  }
+#endif
+}
+
+#ifdef TRIG_BATCH
+  // Bounds of the windows not sent yet, on the records' time base
+#ifdef TIME64
+  uint64_t win_bounds[2 * TRIG_BATCH];
+#else
+  uint32_t win_bounds[2 * TRIG_BATCH];
+#endif
+  uint8_t win_n = 0;
+  uint32_t win_closed_t = 0;
+
+  // #WIN <start> <end> [<start> <end> ...], closed windows only; the start
+  // of an open window waits for the next line
+  void flush_windows() {
+    uint8_t whole = win_n & ~1;
+    if (whole == 0) return;
+    tx.print(F("#WIN"));
+    for (uint8_t i = 0; i < whole; i++) {
+      tx.print('\t');
+      tx.print(win_bounds[i]);
+    }
+    tx.println();
+    if (win_n > whole) win_bounds[0] = win_bounds[whole];
+    win_n -= whole;
+  }
+
+  void batch_window(const sample_typeDef &m) {
+#ifdef TIME64
+    win_bounds[win_n++] = m.t_start_ns;
+#else
+    win_bounds[win_n++] = m.t;
+#endif
+    if (m.kind == SAMPLE_STOP) {
+      win_closed_t = micros();
+      if (win_n == 2 * TRIG_BATCH) flush_windows();
+    }
+  }
+#endif
+
+// Send a partial batch of windows once the trigger went quiet
+void emit_windows() {
+#ifdef TRIG_BATCH
+  if (win_n >= 2 && (uint32_t)(micros() - win_closed_t) >= TRIG_BATCH_FLUSH_MS * 1000UL) flush_windows();
+#endif
+}
+
+// Trigger markers, stamped with their edge
+void emit_marker(const sample_typeDef &m) {
+  const bool start = (m.kind == SAMPLE_START);
+  (void)start;
+#ifdef FILTER
+  // Windows are filtered independently
+  if (start) rail_filter.reset();
+#endif
+#ifdef DEADBAND
+  // Every window opens with a full record
+  if (start) deadband.reset();
+#endif
+#ifdef HISTOGRAM
+  // Trigger windows are histogram windows
+  if (start) hist.reset();
+  else hist.emit(&tx, raw_lsb);
+#endif
+#ifdef COMPRESS
+  // Close the block before the marker, the next window opens on a keyframe
+  coder.flush(&tx);
+  coder.force_key();
+#endif
+#if defined(WINDOW_STATS)
+  if (start) wstats.open(m.t);
+  else wstats.close(m.t, raw_lsb);
+#elif defined(HISTOGRAM)
+  // The #HIST lines carry the window bounds, markers would only make the
+  // host open empty CSV files
+#elif defined(TRIG_BATCH)
+  batch_window(m);
+#else
+  tx.println(start ? F("#START") : F("#STOP"));
+#endif
+}
+
+// Send the window statistics every WSTAT_EVERY_MS
+void emit_wstats() {
+#ifdef WINDOW_STATS
+  static uint32_t last = 0;
+  uint32_t now = millis();
+  if ((uint32_t)(now - last) < WSTAT_EVERY_MS) return;
+  last = now;
+  wstats.emit(&tx, micros());
+#endif
+}
+
+#ifdef PROFILES
+  ProfileStore profiles(TARGET_BOARD);
+  static const char *const board_names[NUM_BOARDS] = {"ZCU102", "ZCU106"};
+
+  // What the build flags would do without a stored profile
+  profile_typeDef default_profile() {
+    profile_typeDef p = {};
+    strncpy(p.name, "default", PROFILE_NAME_LEN);
+    p.board = TARGET_BOARD;
+    p.ina_config = INA_CONFIG_DEFAULT;
+#ifdef EXT_TRIGGER
+    p.trigger = 1;
+#endif
+#ifdef RTOS_ACQ
+    p.period_us = SAMPLE_PERIOD_US;
+#endif
+#ifdef POWER_ALERT
+    p.pwr_limit_w[PS] = PWR_LIMIT_PS_W;
+    p.pwr_limit_w[PL] = PWR_LIMIT_PL_W;
+#endif
+    return p;
+  }
+
+#ifdef EXT_TRIGGER
+  // Without the trigger the profile logs continuously, as one window
+  void set_trigger(const bool &on) {
+    if (on) {
+      attachInterrupt(digitalPinToInterrupt(TRIGGER_PIN), triggerISR, CHANGE);
+      triggerISR();
+    } else {
+      detachInterrupt(digitalPinToInterrupt(TRIGGER_PIN));
+      if (!logging) {
+        // As an edge old enough to pass the debouncing
+        noInterrupts();
+        logging = true;
+        trigger_edge_t = micros() - TRIG_MIN_US;
+#ifdef TIME64
+        trigger_edge_ns = clock64.now_ns();
+#endif
+        interrupts();
+      }
+    }
+  }
+#endif
+
+  void apply_profile(const profile_typeDef *p) {
+    ina->set_config(p->ina_config);
+    if (ina_pl != ina) ina_pl->set_config(p->ina_config);
+#ifdef POWER_ALERT
+    ina->set_pwr_limit(PS, p->pwr_limit_w[PS]);
+    ina_pl->set_pwr_limit(PL, p->pwr_limit_w[PL]);
+#endif
+#if defined(ADAPTIVE_RATE)
+    // The rate controller owns the period
+#elif defined(RTOS_ACQ)
+    // At boot the thread is created with the profile's period
+    if (acq) acq->set_period(p->period_us ? p->period_us : SAMPLE_PERIOD_US);
+#else
+    period_us = p->period_us;
+    next_t = micros();
+#endif
+#ifdef EXT_TRIGGER
+    set_trigger(p->trigger);
+#endif
+  }
+
+  void print_banner() {
+    tx.print(F("#BANNER\t"));
+    tx.print(board_names[TARGET_BOARD]);
+    tx.print('\t');
+    tx.println(profiles.active()->name);
+  }
+
+  void print_profile(const uint8_t &idx) {
+    const profile_typeDef *p = profiles.get(idx);
+    tx.print(F("#PROFILE\t"));
+    tx.print(p->name);
+    tx.print('\t');
+    tx.print(p == profiles.active() ? 1 : 0);
+    tx.print('\t');
+    tx.print(board_names[p->board < NUM_BOARDS ? p->board : (uint8_t)TARGET_BOARD]);
+    tx.print('\t');
+    tx.print(p->ina_config, HEX);
+    tx.print('\t');
+    tx.print(p->period_us);
+    tx.print('\t');
+    tx.print(p->trigger);
+    tx.print('\t');
+    tx.print(p->pwr_limit_w[PS], 3);
+    tx.print('\t');
+    tx.println(p->pwr_limit_w[PL], 3);
+  }
+#endif
+
+#ifdef HOST_COMMANDS
+  // Commands reconfigure the bus and write flash, which must both be idle:
+  // the acquisition thread is held off, the other loops have no transfers
+  // in flight when commands are polled
+  void hold_acquisition(const bool &hold) {
+#ifdef RTOS_ACQ
+    if (hold) acq->pause();
+    else acq->resume();
+#else
+    (void)hold;
+#endif
+  }
+
+  bool run_command(const char *cmd) {
+#ifdef AUTO_RAILS
+    if (strcmp(cmd, "SCAN") == 0) {
+      hold_acquisition(true);
+      discover_rails(true);
+      hold_acquisition(false);
+      return true;
+    }
+#endif
+#ifdef PROFILES
+    if (strcmp(cmd, "PROFILES") == 0) {
+      for (uint8_t i = 0; i < profiles.count(); i++) print_profile(i);
+      return true;
+    }
+    if (strncmp(cmd, "PROFILE ", 8) == 0) {
+      // Held before select(), which may erase and write flash
+      hold_acquisition(true);
+      bool ok = profiles.select(cmd + 8);
+      if (ok) apply_profile(profiles.active());
+      hold_acquisition(false);
+      if (!ok) return false;
+      print_banner();
+      return true;
+    }
+    if (strncmp(cmd, "PSET ", 5) == 0 || strncmp(cmd, "PDEL ", 5) == 0) {
+      // PSET <name> [key=value ...], PDEL <name>
+      char name[PROFILE_NAME_LEN];
+      const char *arg = cmd + 5;
+      const char *end = strchr(arg, ' ');
+      size_t len = end ? (size_t)(end - arg) : strlen(arg);
+      if (len >= PROFILE_NAME_LEN) return false;
+      memcpy(name, arg, len);
+      name[len] = '\0';
+
+      const profile_typeDef *before = profiles.active();
+      char before_name[PROFILE_NAME_LEN];
+      strncpy(before_name, before->name, PROFILE_NAME_LEN);
+      hold_acquisition(true);
+      bool ok = (cmd[1] == 'S') ? profiles.set(name, arg + len) : profiles.remove(name);
+      // Re-apply when the active profile was edited or replaced
+      bool changed = ok && (strncmp(name, profiles.active()->name, PROFILE_NAME_LEN) == 0 ||
+                            strncmp(before_name, profiles.active()->name, PROFILE_NAME_LEN) != 0);
+      if (changed) apply_profile(profiles.active());
+      hold_acquisition(false);
+      if (!ok) return false;
+      if (changed) print_banner();
+      int8_t idx = profiles.find(name);
+      if (idx >= 0) print_profile(idx);
+      return true;
+    }
+#endif
+    return false;
+  }
+
+  // Host commands, one per line; rejected ones are echoed as #ERR
+  void poll_commands() {
+    static char cmd[96];
+    static uint8_t len = 0;
+
+    while (Serial.available() > 0) {
+      char c = Serial.read();
+      if (c != '\n' && c != '\r') {
+        if (len < sizeof(cmd) - 1) cmd[len++] = c;
+        continue;
+      }
+      if (len == 0) continue;
+      cmd[len] = '\0';
+      len = 0;
+      if (!run_command(cmd)) {
+        tx.print(F("#ERR\t"));
+        tx.println(cmd);
+      }
+    }
   }
 #endif
 
 void setup() {
   Serial.begin(2'000'000);
   pinMode(LED_BUILTIN, OUTPUT);
+#ifdef TIME64
+  clock64.begin();
+#endif
 
 #ifdef EXT_TRIGGER
   pinMode(TRIGGER_PIN, INPUT);               
   attachInterrupt(digitalPinToInterrupt(TRIGGER_PIN), triggerISR, CHANGE);
 #endif
+#ifdef SYNC_PULSE
+#ifdef SYNC_MASTER
+  pinMode(SYNC_PIN, OUTPUT);
+  digitalWrite(SYNC_PIN, LOW);
+#else
+  pinMode(SYNC_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(SYNC_PIN), sync_edge, RISING);
+#endif
+#endif
+#ifdef EXT_CLOCK
+  pinMode(EXT_CLOCK_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(EXT_CLOCK_PIN), clockISR, RISING);
+#endif
 
-#if defined(BOARD_ZCU106)
-  ina = new INA226(ZCU106);
-#elif defined(BOARD_ZCU102)
-  ina = new INA226(ZCU102);
+#ifdef TARGET_BOARD
+  ina = new INA226(TARGET_BOARD);
+#ifdef DUAL_BUS
+  // PS stays on Wire, PL moves to the second Pmod on Wire1: each mux keeps
+  // its channel routed and the two rails no longer share bus time
+  ina_pl = new INA226(TARGET_BOARD, &Wire1);
+#else
+  ina_pl = ina;
+#endif
+#ifdef AUTO_RAILS
+  discover_rails(false);
+#endif
+  rail_sensor[PS] = ina;
+  rail_channel[PS] = PS;
+  rail_sensor[PL] = ina_pl;
+  rail_channel[PL] = PL;
+#ifdef SHUNT_ONLY
+  // Before the LSBs are read below: the INA226 columns become currents
+  ina->set_shunt_only(true);
+  if (ina_pl != ina) ina_pl->set_shunt_only(true);
+#endif
+
+#if PMBUS_RAILS > 0
+  // Regulators are read on the PS bus, behind their own mux channel
+  pmbus = new PMBus(ina, PMBUS_MUX_CH, &Wire, PMBUS_USE_PEC);
+  for (int i = 0; i < PMBUS_RAILS; i++) {
+    bool ok = pmbus->add_rail(pmbus_rails[i] >> 8, pmbus_rails[i] & 0xff);
+    rail_sensor[NUM_SENS + i] = pmbus;
+    rail_channel[NUM_SENS + i] = i;
+
+    char model[PMBUS_BLOCK_MAX + 1];
+    int8_t len = ok ? pmbus->read_block(pmbus_rails[i] >> 8, PMBUS_MFR_MODEL, (uint8_t *)model, PMBUS_BLOCK_MAX) : -1;
+    model[len > 0 ? len : 0] = '\0';
+    tx.print(F("#PMBUS\t"));
+    tx.print(NUM_SENS + i);
+    tx.print('\t');
+    tx.print(pmbus_rails[i] >> 8);
+    tx.print('\t');
+    tx.print(pmbus_rails[i] & 0xff);
+    tx.print('\t');
+    tx.print(ok ? 1 : 0);
+    tx.print('\t');
+    tx.println(model);
+  }
+#endif
+
+  for (int i = 0; i < NUM_RAILS; i++) raw_lsb[i] = rail_sensor[i]->raw_lsb_uw(rail_channel[i]);
+#ifdef SHUNT_ONLY
+  for (int i = 0; i < NUM_RAILS; i++)
+    raw_lsb[i] = (i < NUM_SENS) ? (i == PS ? ina : ina_pl)->cur_lsb_na((sensor_typeDef)i) : raw_lsb[i] * 1000;
+#endif
+
+#ifdef POWER_ALERT
+#ifdef THROTTLE_PIN
+  pinMode(THROTTLE_PIN, OUTPUT);
+  digitalWrite(THROTTLE_PIN, LOW);
+#endif
+  pinMode(ALERT_PIN_PS, INPUT_PULLUP);
+  pinMode(ALERT_PIN_PL, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(ALERT_PIN_PS), alertISR_PS, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(ALERT_PIN_PL), alertISR_PL, CHANGE);
+  ina->set_pwr_limit(PS, PWR_LIMIT_PS_W);
+  ina_pl->set_pwr_limit(PL, PWR_LIMIT_PL_W);
+#endif
 #else
   digitalWrite(LED_BUILTIN, HIGH);
 #endif
 
   delay(1000);
+
+#ifdef RTOS_ACQ
+#ifdef ADAPTIVE_RATE
+  acq = new AcqThread(acquire, ADAPT_SLOW_US);
+#else
+  acq = new AcqThread(acquire, SAMPLE_PERIOD_US);
+#endif
+#endif
+#ifdef PROFILES
+  if (!profiles.begin(default_profile())) {
+    // The stored profile was made for another board
+    tx.println(F("#ERR\tPROFILE"));
+  }
+  apply_profile(profiles.active());
+  print_banner();
+#endif
+#ifdef RTOS_ACQ
+  acq->start();
+#endif
 }
 
 void loop() {
-#ifdef EXT_TRIGGER
-  if (interrupt) {
-    noInterrupts();
-    bool current = logging;
-    interrupt = false;
-    interrupts();
-    Serial.println(current ? F("#START") : F("#STOP"));
+#ifdef HOST_COMMANDS
+  poll_commands();
+#endif
+  emit_alerts();
+  emit_sync();
+  emit_windows();
+  emit_wstats();
+
+#ifdef RTOS_ACQ
+  sample_typeDef s;
+  while (samples.pop(s)) {
+    if (s.kind == SAMPLE_DATA) emit_sample(s);
+    else emit_marker(s);
   }
 
-  if (!logging) {
+  // Records lost on a full queue and periods missed by the thread
+  static uint32_t reported = 0;
+  uint32_t lost = dropped.load(std::memory_order_relaxed) + acq->overruns();
+  if (lost != reported) {
+    tx.print(F("#DROP\t"));
+    tx.println(lost);
+    reported = lost;
+  }
+  tx.poll();
+  return;
+#endif
+
+#ifdef EXT_TRIGGER
+  sample_typeDef mark;
+  if (trigger_changed(mark)) emit_marker(mark);
+
+  if (!window_open) {
+#ifdef LOOP_PACING
+    // Idle, not late: the schedule restarts with the window
+    next_t = micros();
+#endif
+    tx.poll();
     delayMicroseconds(1);
     return;
   }
 #endif
 
-  pwr_ps = ina->get_pwr(PS);
-  pwr_pl = ina->get_pwr(PL);
+#ifdef EXT_CLOCK
+  static uint32_t missed_reported = 0;
+  bool due = clock_due();
+  if (clock_missed != missed_reported) {
+    tx.print(F("#DROP\t"));
+    tx.println(clock_missed);
+    missed_reported = clock_missed;
+  }
+  if (!due) {
+    tx.poll();
+    return;
+  }
+#elif defined(LOOP_PACING)
+  // Pace the free-running loop at the profile's or the rate controller's
+  // period, skipping whole periods when it falls behind
+  static uint32_t missed_reported = 0;
+  if (pace_missed != missed_reported) {
+    tx.print(F("#DROP\t"));
+    tx.println(pace_missed);
+    missed_reported = pace_missed;
+  }
+  uint32_t now = micros();
+  if (!period_us) {
+    next_t = now;
+  } else if ((int32_t)(now - next_t) < 0) {
+    tx.poll();
+    return;
+  } else if ((uint32_t)(now - next_t) >= period_us) {
+    pace_missed += (now - next_t) / period_us;
+    next_t = now;
+  }
+#endif
 
-  Serial.print(micros());
-  Serial.print('\t');
-  Serial.print(pwr_ps, 5);
-  Serial.print('\t');
-  Serial.println(pwr_pl, 5);
+  // With ASYNC_I2C and DUAL_BUS the two rails are read concurrently on
+  // Wire and Wire1; the record is printed once its read has ended
+  sample_typeDef sample;
+  read_sample(sample);
+  emit_sample(sample);
+  tx.poll();
 }
\ No newline at end of file